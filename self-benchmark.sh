@@ -15,7 +15,6 @@ defaults=$(<<EOF
 -DDEFAULT_KINC='0'
 -DDEFAULT_UNREAL_X='UNREAL_X_BOTH'
 -DVECTOR_ELT_T='char'
--DK_BOUNDED_SAFETY_AUT_IMPL='k_bounded_safety_aut'
 -DSTATIC_ARRAY_MAX='300'
 -DSTATIC_MAX_BITSETS='8ul'
 -DSIMD_IS_MAX='true'
@@ -63,6 +62,7 @@ confs=(
     [iosprecom_delegate]="-DIOS_PRECOMPUTER=ios_precomputers::delegate -DACTIONER='actioners::no_ios_precomputation<typename SetOfStates::value_type>'"
     [iosprecom_fake_vars]="-DIOS_PRECOMPUTER=ios_precomputers::fake_vars"
     [iosprecom_powset]="-DIOS_PRECOMPUTER=ios_precomputers::powset"
+    [iosprecom_powset_inv]="-DIOS_PRECOMPUTER=ios_precomputers::powset_inv"
     [inputpicker_critical]="-DINPUT_PICKER=input_pickers::critical"
     [inputpicker_critical_pq]="-DINPUT_PICKER=input_pickers::critical_pq"
     [inputpicker_critical_rnd]="-DINPUT_PICKER=input_pickers::critical_rnd"
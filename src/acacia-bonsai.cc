@@ -3,10 +3,17 @@
 #include <string>
 #include <sstream>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 #include <algorithm>
 
+#include <fstream>
+#include <map>
+#include <optional>
+
 #include <signal.h>
+#include <wordexp.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 
 #include <boost/algorithm/string.hpp>
@@ -21,6 +28,7 @@
 #include "aut_preprocessors.hh"
 
 #include "k-bounded_safety_aut.hh"
+#include "strategies.hh"
 
 #include <posets/vectors.hh>
 #include <posets/downsets.hh>
@@ -29,6 +37,7 @@
 
 #include <utils/verbose.hh>
 #include <utils/cache.hh>
+#include <utils/cancel.hh>
 
 #include "configuration.hh"
 #include "composition/composition_mt.hh"
@@ -65,7 +74,18 @@ enum {
   OPT_SYNTH = 'S',
   OPT_WINREG = 'W',
   OPT_WORKERS = 'j',
-  OPT_INIT = '0'
+  OPT_THREADS = 't',
+  OPT_INIT = '0',
+  // no short options
+  OPT_SPLIT = 256,
+  OPT_CACHE_DIR,
+  OPT_BATCH,
+  OPT_BATCH_JOBS,
+  OPT_BATCH_FORMAT,
+  OPT_AUT_PREPROCESSOR,
+  OPT_BOOLEAN_STATES,
+  OPT_SOLVER,
+  OPT_PORTFOLIO
 } ;
 
 static const argp_option options[] = {
@@ -97,6 +117,33 @@ static const argp_option options[] = {
     "workers", OPT_WORKERS, "VAL", 0,
     "Number of parallel workers for composition", 0
   },
+  {
+    "threads", OPT_THREADS, "VAL", 0,
+    "Number of threads used to compute CPre in each solving process", 0
+  },
+  {
+    "split", OPT_SPLIT, nullptr, 0,
+    "split a single formula into its top-level conjuncts, distributing"
+    " implications over them, and solve these by composition", 0
+  },
+  {
+    "cache-dir", OPT_CACHE_DIR, "DIR", 0,
+    "keep the translated and solved games of the formulas in DIR, and reuse"
+    " them in later runs (composition only)", 0
+  },
+  {
+    "batch", OPT_BATCH, "MANIFEST", 0,
+    "solve the specifications of MANIFEST, whose lines hold the options of"
+    " one run each (e.g., -F spec.ltl --ins=a --outs=b), and print one record"
+    " per run; the options given here are the defaults of all the runs, those"
+    " that can be repeated (--ins, --outs, --init, --portfolio) being replaced"
+    " as a whole by those of a run.  -x cannot be given in MANIFEST", 0
+  },
+  {
+    "batch-jobs", OPT_BATCH_JOBS, "VAL", 0,
+    "number of runs of the batch made in parallel (default: number of"
+    " processors)", 0
+  },
   /**************************************************/
   { nullptr, 0, nullptr, 0, "Fine tuning:", 10 },
   {
@@ -125,6 +172,43 @@ static const argp_option options[] = {
       return s.c_str ();
     } (), 0
   },
+  {
+    "aut-preprocessor", OPT_AUT_PREPROCESSOR, "NAME", 0,
+    [] () {
+      static const auto s =
+        "preprocessing of the automaton, among: " + strategies::aut_preprocessors::list () +
+        " (default: as configured at compile time)";
+      return s.c_str ();
+    } (), 0
+  },
+  {
+    "boolean-states", OPT_BOOLEAN_STATES, "NAME", 0,
+    [] () {
+      static const auto s =
+        "detection of the states that are visited at most once, among: " +
+        strategies::boolean_states::list () + " (default: as configured at compile time)";
+      return s.c_str ();
+    } (), 0
+  },
+  {
+    "solver", OPT_SOLVER, "NAME", 0,
+    [] () {
+      static const auto s =
+        "IOs precomputer, actioner and input picker used to solve the games,"
+        " among: " + strategies::solvers::list () + " (default: as configured at compile time)";
+      return s.c_str ();
+    } (), 0
+  },
+
+  {
+    "portfolio", OPT_PORTFOLIO, "CONF", 0,
+    "add a configuration to the portfolio of the realizability check; each is"
+    " checked by its own process, and the first verdict wins.  CONF is a"
+    " comma-separated list of K=VAL, Kmin=VAL, Kinc=VAL, aut-preprocessor=NAME,"
+    " boolean-states=NAME, and solver=NAME, the other options being kept;"
+    " setting one of K, Kmin, Kinc sets the three as the options of the same"
+    " names do.  Can be repeated", 0
+  },
 
   /**************************************************/
   { nullptr, 0, nullptr, 0, "Output options:", 20 },
@@ -132,6 +216,10 @@ static const argp_option options[] = {
     "check", OPT_CHECK, "[real|unreal|both]", 0,
     "either check for real, unreal, or both", 0
   },
+  {
+    "batch-format", OPT_BATCH_FORMAT, "[jsonl|csv]", 0,
+    "format of the records of the batch mode (default: jsonl)", 0
+  },
   {
     "verbose", OPT_VERBOSE, nullptr, 0,
     "verbose mode, can be repeated for more verbosity", -1
@@ -161,6 +249,24 @@ static std::string synth_fname;
 static std::string winreg_fname;
 static std::vector<int> init_state;
 static int workers = 0;
+static bool opt_split = false;
+static std::string cache_dir;
+static std::string batch_fname;
+static unsigned batch_jobs = 0;
+
+enum {
+  BATCH_JSONL,
+  BATCH_CSV
+} batch_format = BATCH_JSONL;
+
+// process groups of the runs of the batch in progress, one slot per job; the
+// size is fixed before any run starts, as terminate () reads it
+static std::vector<pid_t> batch_runs;
+// whether the options being parsed are those of an entry of the batch
+static bool in_batch_entry = false;
+// exit status of a run of the batch that could not decide, as 2 and 3 are
+// those of errors
+const int BATCH_UNKNOWN = 4;
 
 
 enum {
@@ -170,6 +276,15 @@ enum {
 } opt_check = CHECK_REAL;
 
 static auto opt_unreal_x = DEFAULT_UNREAL_X;
+static strategies::choice strategy;
+
+// a configuration of the portfolio, overriding some of the options above
+struct portfolio_config {
+  std::string name; // as given on the command line
+  std::optional<unsigned> K, Kmin, Kinc;
+  std::optional<size_t> aut_preprocessor, boolean_states, solver;
+};
+static std::vector<portfolio_config> portfolio;
 
 static bool check_real = true;
 static unsigned opt_K = DEFAULT_K,
@@ -177,22 +292,153 @@ static unsigned opt_K = DEFAULT_K,
 static spot::option_map extra_options;
 
 int               utils::verbose = 0;
+unsigned          utils::threads = DEFAULT_THREADS;
 utils::voutstream utils::vout;
+std::vector<utils::cancel_flag> utils::cancel_flags;
 
 size_t posets::vectors::bool_threshold = 0;
 size_t posets::vectors::bitset_threshold = 0;
 
 namespace {
 
+  portfolio_config parse_portfolio_config (const char* arg) {
+    portfolio_config conf;
+    conf.name = arg;
+
+    std::istringstream items (arg);
+    std::string item;
+    while (std::getline (items, item, ',')) {
+      item.erase (remove_if (item.begin (), item.end (), isspace), item.end ());
+      auto eq = item.find ('=');
+      if (eq == std::string::npos)
+        error (3, 0, "portfolio: expected KEY=VALUE, got '%s'.", item.c_str ());
+      auto key = item.substr (0, eq), val = item.substr (eq + 1);
+
+      const auto number = [&] () {
+        unsigned v = atoi (val.c_str ());
+        if (v == 0)
+          error (3, 0, "portfolio: %s cannot be 0 or not a number.", key.c_str ());
+        return v;
+      };
+      const auto name = [&] <typename Registry> (Registry) {
+        size_t i = Registry::find (val);
+        if (i == Registry::size)
+          error (3, 0, "portfolio: %s should be one of: %s.", key.c_str (), Registry::list ().c_str ());
+        return i;
+      };
+
+      if (key == "K")
+        conf.K = number ();
+      else if (key == "Kmin")
+        conf.Kmin = number ();
+      else if (key == "Kinc")
+        conf.Kinc = number ();
+      else if (key == "aut-preprocessor")
+        conf.aut_preprocessor = name (strategies::aut_preprocessors {});
+      else if (key == "boolean-states")
+        conf.boolean_states = name (strategies::boolean_states {});
+      else if (key == "solver")
+        conf.solver = name (strategies::solvers {});
+      else
+        error (3, 0, "portfolio: unknown key '%s'.", key.c_str ());
+    }
+    return conf;
+  }
+
+  // give the configuration its full K schedule, checking it, once the options
+  // it overrides are known
+  void resolve_portfolio_config (portfolio_config& conf) {
+    if (conf.K or conf.Kmin or conf.Kinc) {
+      unsigned K = conf.K.value_or (opt_K);
+      unsigned Kmin = conf.Kmin.value_or (K);
+      unsigned Kinc = conf.Kinc.value_or (0);
+      if (Kmin > K or (Kmin < K and Kinc == 0))
+        error (3, 0, "portfolio: incompatible values for K, Kmin, and Kinc in '%s'.",
+               conf.name.c_str ());
+      conf.K = K;
+      conf.Kmin = Kmin;
+      conf.Kinc = Kinc;
+    }
+  }
+
+  void apply_portfolio_config (const portfolio_config& conf) {
+    if (conf.K) {
+      opt_K = *conf.K;
+      opt_Kmin = *conf.Kmin;
+      opt_Kinc = *conf.Kinc;
+    }
+    if (conf.aut_preprocessor)
+      strategy.aut_preprocessor = *conf.aut_preprocessor;
+    if (conf.boolean_states)
+      strategy.boolean_states = *conf.boolean_states;
+    if (conf.solver)
+      strategy.solver = *conf.solver;
+  }
+
+  // the conjuncts of f: a & b is split into the conjuncts of a and b, and
+  // a -> (b & c) into a -> b and a -> c, both being equivalent to f
+  std::vector<spot::formula> split_conjuncts (spot::formula f) {
+    std::vector<spot::formula> res;
+    if (f.is (spot::op::And)) {
+      for (auto child : f) {
+        auto sub = split_conjuncts (child);
+        res.insert (res.end (), sub.begin (), sub.end ());
+      }
+    }
+    else if (f.is (spot::op::Implies)) {
+      for (auto conclusion : split_conjuncts (f[1]))
+        res.push_back (spot::formula::Implies (f[0], conclusion));
+    }
+    else
+      res.push_back (f);
+    return res;
+  }
+
   class ltl_processor final : public job_processor {
     private:
       spot::translator &trans_;
       std::vector<std::string> input_aps_;
       std::vector<std::string> output_aps_;
       std::vector<spot::formula> formulas;
+      bool collected = false; // whether formulas holds the formulas of -f and -F
+      composition_mt::translations_t translations;
 
       spot::bdd_dict_ptr dict;
 
+      // read the formulas, once
+      void collect () {
+        if (collected)
+          return;
+        // call base class ::run which adds the formulas passed with -f to the vector
+        job_processor::run ();
+        collected = true;
+      }
+
+      // the conjunctions of the inputs and of the outputs
+      std::pair<bdd, bdd> register_aps () {
+        // manually register inputs/outputs
+        bdd all_inputs = bddtrue;
+        bdd all_outputs = bddtrue;
+
+        for(std::string ap: input_aps) {
+          unsigned v = dict->register_proposition (spot::formula::ap (ap), this);
+          all_inputs &= bdd_ithvar (v);
+        }
+        for(std::string ap: output_aps) {
+          unsigned v = dict->register_proposition (spot::formula::ap (ap), this);
+          all_outputs &= bdd_ithvar (v);
+        }
+        return { all_inputs, all_outputs };
+      }
+
+      // the formulas to solve, split if asked and if composition is possible
+      std::vector<spot::formula> formulas_to_solve (bool real) const {
+        if (opt_split and formulas.size () == 1 and real and
+            init_state.empty () and opt_Kinc == 0)
+          return split_conjuncts (formulas[0]);
+        return formulas;
+      }
+
     public:
 
       ltl_processor (spot::translator &trans,
@@ -207,30 +453,46 @@ namespace {
         return 0;
       }
 
+      // Translate the negated formulas, which all the processes checking
+      // realizability need, before they are forked: they inherit the automata.
+      // Several formulas are solved by composition, whose workers translate
+      // them in parallel, which is faster than translating them all here.
+      void translate_for_real () {
+        collect ();
+        auto to_solve = formulas_to_solve (true);
+        if (to_solve.size () > 1) {
+          verb_do (1, vout << to_solve.size () << " formulas left to the composition workers to translate\n");
+          return;
+        }
+        register_aps (); // as the processes do first, for the same order of the variables
+        for (auto f : to_solve) {
+          auto neg = spot::formula::Not (f);
+          if (not translations.contains (neg))
+            translations.emplace (neg, composition_mt::translate (trans_, neg));
+        }
+        verb_do (1, vout << translations.size () << " automata translated for the processes\n");
+      }
+
       int run () override {
-        // call base class ::run which adds the formulas passed with -f to the vector
-        job_processor::run ();
+        collect ();
 
         if (formulas.empty ()) {
           utils::vout << "Pass a formula!\n";
           return 0;
         }
 
-        // manually register inputs/outputs
-        bdd all_inputs = bddtrue;
-        bdd all_outputs = bddtrue;
-
-        for(std::string ap: input_aps) {
-          unsigned v = dict->register_proposition (spot::formula::ap (ap), this);
-          all_inputs &= bdd_ithvar (v);
-        }
-        for(std::string ap: output_aps) {
-          unsigned v = dict->register_proposition (spot::formula::ap (ap), this);
-          all_outputs &= bdd_ithvar (v);
-        }
+        auto [all_inputs, all_outputs] = register_aps ();
 
         composition_mt composer (opt_K, opt_Kmin, opt_Kinc, dict, trans_, all_inputs, all_outputs, input_aps_, output_aps_,
                                  init_state);
+        composer.set_strategies (strategy);
+        composer.set_translations (translations);
+
+        // splitting only makes sense where composition is possible
+        if (auto split = formulas_to_solve (check_real); split.size () != formulas.size ()) {
+          formulas = std::move (split);
+          verb_do (1, vout << "Formula split into " << formulas.size () << " conjuncts\n");
+        }
 
         if (formulas.size () == 1) {
           // one formula: don't make subprocesses, do everything here by calling the functions directly
@@ -258,6 +520,9 @@ namespace {
           composer.add_formula (f);
         }
 
+        if (not cache_dir.empty ())
+          composer.set_cache_dir (cache_dir);
+
         return composer.run (workers, synth_fname, winreg_fname);
       }
 
@@ -265,6 +530,120 @@ namespace {
         dict->unregister_all_my_variables (this);
       }
   };
+
+  // the options of a manifest entry, split as a shell would
+  std::vector<std::string> split_entry (const std::string& entry) {
+    wordexp_t we;
+    if (wordexp (entry.c_str (), &we, WRDE_NOCMD) != 0)
+      error (3, 0, "cannot parse batch entry: %s", entry.c_str ());
+    std::vector<std::string> args (we.we_wordv, we.we_wordv + we.we_wordc);
+    wordfree (&we);
+    return args;
+  }
+
+  // Batch mode: each entry of the manifest is solved by a process forked from
+  // this one, which parses the options of the entry with run_entry () and
+  // returns its exit status.  The entries thus share the startup and the
+  // initialization of BuDDy and of the translator, and each starts from the
+  // same state, as whatever they change is dropped with their process.
+  template <typename RunEntry>
+  int run_batch (RunEntry&& run_entry) {
+    std::ifstream manifest (batch_fname);
+    if (not manifest)
+      error (3, errno, "cannot open %s", batch_fname.c_str ());
+
+    if (batch_jobs == 0)
+      batch_jobs = std::max (1l, sysconf (_SC_NPROCESSORS_ONLN));
+    batch_runs.assign (batch_jobs, 0);
+
+    struct run_t {
+      unsigned slot, line;
+      std::string entry;
+      spot::stopwatch sw;
+    };
+    std::map<pid_t, run_t> running;
+
+    if (batch_format == BATCH_CSV)
+      std::cout << "line,entry,verdict,status,time,cpu_time,max_rss_kb" << std::endl;
+
+    const auto print_record = [] (run_t& run, int status, const rusage& ru) {
+      int code = WIFEXITED (status) ? WEXITSTATUS (status) : 128 + WTERMSIG (status);
+      const char* verdict = (not WIFEXITED (status) ? "ERROR" :
+                             code == 0 ? "REALIZABLE" :
+                             code == 1 ? "UNREALIZABLE" :
+                             code == BATCH_UNKNOWN ? "UNKNOWN" : "ERROR");
+      double time = run.sw.stop ();
+      double cpu_time = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+                         (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6);
+
+      if (batch_format == BATCH_CSV) {
+        std::cout << run.line << ',';
+        spot::escape_rfc4180 (std::cout << '"', run.entry) << '"';
+        std::cout << ',' << verdict << ',' << code << ',' << time << ','
+                  << cpu_time << ',' << ru.ru_maxrss << std::endl;
+      }
+      else {
+        std::cout << "{\"line\": " << run.line << ", \"entry\": \"";
+        spot::escape_str (std::cout, run.entry);
+        std::cout << "\", \"verdict\": \"" << verdict << "\", \"status\": " << code
+                  << ", \"time\": " << time << ", \"cpu_time\": " << cpu_time
+                  << ", \"max_rss_kb\": " << ru.ru_maxrss << "}" << std::endl;
+      }
+    };
+
+    std::string entry;
+    unsigned line = 0;
+    bool more = true;
+    while (true) {
+      // start runs while there are free slots
+      while (more and running.size () < batch_jobs and not utils::cancel_requested ()) {
+        if (not std::getline (manifest, entry)) {
+          more = false;
+          break;
+        }
+        ++line;
+        boost::algorithm::trim (entry);
+        if (entry.empty () or entry[0] == '#')
+          continue;
+
+        unsigned slot = std::find (batch_runs.begin (), batch_runs.end (), 0) - batch_runs.begin ();
+        pid_t pid = fork ();
+        if (pid == 0) {
+          batch_runs.clear ();
+          setpgid (0, 0);  // so that the run can stop its own processes
+          dup2 (2, 1);     // stdout only holds the records
+          exit (run_entry (entry));
+        }
+        setpgid (pid, pid);
+        batch_runs[slot] = pid;
+        auto& run = running[pid] = { slot, line, entry, {} };
+        run.sw.start ();
+        verb_do (1, vout << "Batch entry " << line << " started\n");
+      }
+
+      if (running.empty ())
+        break;
+
+      int status;
+      rusage ru;
+      pid_t pid = wait4 (-1, &status, 0, &ru);
+      if (pid == -1) {
+        if (errno == EINTR)
+          continue;
+        break;  // the children were stopped by terminate ()
+      }
+      auto it = running.find (pid);
+      if (it == running.end ())
+        continue;
+      // the run may have been stopped by terminate () with its segments
+      pipe_t::discard_group_segments (pid);
+      print_record (it->second, status, ru);
+      batch_runs[it->second.slot] = 0;
+      running.erase (it);
+    }
+
+    return utils::cancel_requested () ? 3 : 0;
+  }
 }
 
 static int
@@ -333,6 +712,48 @@ parse_opt (int key, char *arg, struct argp_state *) {
       break;
     }
 
+    case OPT_SPLIT: {
+      opt_split = true;
+      break;
+    }
+
+    case OPT_CACHE_DIR: {
+      cache_dir = arg;
+      break;
+    }
+
+    case OPT_BATCH: {
+      batch_fname = arg;
+      break;
+    }
+
+    case OPT_BATCH_JOBS: {
+      int jobs = atoi (arg);
+      if (jobs <= 0)
+        error (3, 0, "batch-jobs should be a positive number.");
+      batch_jobs = jobs;
+      break;
+    }
+
+    case OPT_BATCH_FORMAT: {
+      boost::algorithm::to_lower (arg);
+      if (arg == "jsonl"sv)
+        batch_format = BATCH_JSONL;
+      else if (arg == "csv"sv)
+        batch_format = BATCH_CSV;
+      else
+        error (3, 0, "Should specify jsonl or csv.");
+      break;
+    }
+
+    case OPT_THREADS: {
+      int threads = atoi (arg);
+      if (threads <= 0)
+        error (3, 0, "threads should be a positive number.");
+      utils::threads = threads;
+      break;
+    }
+
     case OPT_UNREAL_X: {
       boost::algorithm::to_lower (arg);
       if (arg == "formula"sv)
@@ -346,6 +767,32 @@ parse_opt (int key, char *arg, struct argp_state *) {
       break;
     }
 
+    case OPT_AUT_PREPROCESSOR: {
+      strategy.aut_preprocessor = strategies::aut_preprocessors::find (arg);
+      if (strategy.aut_preprocessor == strategies::aut_preprocessors::size)
+        error (3, 0, "Should specify one of: %s.", strategies::aut_preprocessors::list ().c_str ());
+      break;
+    }
+
+    case OPT_BOOLEAN_STATES: {
+      strategy.boolean_states = strategies::boolean_states::find (arg);
+      if (strategy.boolean_states == strategies::boolean_states::size)
+        error (3, 0, "Should specify one of: %s.", strategies::boolean_states::list ().c_str ());
+      break;
+    }
+
+    case OPT_SOLVER: {
+      strategy.solver = strategies::solvers::find (arg);
+      if (strategy.solver == strategies::solvers::size)
+        error (3, 0, "Should specify one of: %s.", strategies::solvers::list ().c_str ());
+      break;
+    }
+
+    case OPT_PORTFOLIO: {
+      portfolio.push_back (parse_portfolio_config (arg));
+      break;
+    }
+
     case OPT_CHECK: {
       boost::algorithm::to_lower (arg);
       if (arg == "real"sv)
@@ -386,6 +833,9 @@ parse_opt (int key, char *arg, struct argp_state *) {
     }
 
     case 'x': {
+      // the translator is set up once for the whole batch
+      if (in_batch_entry)
+        error (3, 0, "-x cannot be given in a batch entry.");
       const char *opt = extra_options.parse_options (arg);
 
       if (opt)
@@ -399,9 +849,15 @@ parse_opt (int key, char *arg, struct argp_state *) {
 }
 
 void terminate (int signum) {
-  if (getpgid (0) == getpid ()) { // Main process
+  if (getpgid (0) == getpid ()) { // Main process, or a run of the batch
+    // the other processes are not reused once a verdict is known, so they are
+    // stopped right away; the flag keeps a batch from starting new runs
+    utils::cancel_flags.back ().set ();
     signal (SIGTERM, SIG_IGN);
     kill (0, SIGTERM);
+    for (pid_t run : batch_runs)
+      if (run > 0)
+        kill (-run, SIGTERM);
     while (wait (NULL) != -1)
       /* no body */;
   }
@@ -410,6 +866,11 @@ void terminate (int signum) {
 }
 
 int main (int argc, char **argv) {
+  // shared by all the processes forked from now on; created before the
+  // handlers, which set it
+  utils::cancel_flags.emplace_back ();
+  utils::cancel_flags.back ().create ();
+
   struct sigaction action;
   memset (&action, 0, sizeof(struct sigaction));
   action.sa_handler = terminate;
@@ -430,76 +891,165 @@ int main (int argc, char **argv) {
 
     if (int err = argp_parse (&ap, argc, argv, ARGP_NO_HELP, nullptr, nullptr))
       exit (err);
-    check_no_formula ();
+    if (batch_fname.empty ())
+      check_no_formula ();
 
     // Setup the dictionary now, so that BuDDy's initialization is
     // not measured in our timings.
     spot::bdd_dict_ptr dict = spot::make_bdd_dict ();
     spot::translator trans (dict, &extra_options);
-    ltl_processor processor (trans, input_aps, output_aps, dict);
 
     // Diagnose unused -x options
     extra_options.report_unused_options ();
 
-    // Adjust the value of K
-    if (opt_Kmin == -1u)
-      opt_Kmin = opt_K;
-    if (opt_Kmin > opt_K or (opt_Kmin < opt_K and opt_Kinc == 0))
-      error (3, 0, "Incompatible values for K, Kmin, and Kinc.");
-    if (opt_Kmin == 0)
-      opt_Kmin = opt_K;
-
-    const auto start_proc = [&] (bool real, unreal_x_t unreal_x) {
-      if (fork () == 0) {
-        utils::vout.set_prefix (std::string {"["}
-                                + (real ?
-                                   "real" :
-                                   std::string {"unreal-x="} + (char) unreal_x)
-                                + "] ");
-        check_real = real;
-        if (!real) {
-          synth_fname = ""; // no synthesis for the environment if the formula is unrealizable
-        }
-        opt_unreal_x = unreal_x;
-        int res = processor.run ();
-        verb_do (1, vout << "returning " << (res ? 1 - real : 3) << "\n");
-        exit (res ? 1 - real : 3);  // 0 if real, 1 if unreal, 3 if unknown
-      }
+    const auto adjust_K = [] () {
+      if (opt_Kmin == -1u)
+        opt_Kmin = opt_K;
+      if (opt_Kmin > opt_K or (opt_Kmin < opt_K and opt_Kinc == 0))
+        error (3, 0, "Incompatible values for K, Kmin, and Kinc.");
+      if (opt_Kmin == 0)
+        opt_Kmin = opt_K;
     };
 
-    setpgid (0, 0);
-    assert (getpgid (0) == getpid ());
-    if (opt_check == CHECK_BOTH or opt_check == CHECK_REAL)
-      start_proc (true, UNREAL_X_BOTH);
-    if (opt_check == CHECK_BOTH or opt_check == CHECK_UNREAL) {
-      if (opt_unreal_x == UNREAL_X_BOTH or opt_unreal_x == UNREAL_X_FORMULA)
-        start_proc (false, UNREAL_X_FORMULA);
-      if (opt_unreal_x == UNREAL_X_BOTH or opt_unreal_x == UNREAL_X_AUTOMATON)
-        start_proc (false, UNREAL_X_AUTOMATON);
-    }
+    // start the processes for the checks, and return the verdict of the
+    // first that decides: 0 if realizable, 1 if unrealizable, 3 if unknown
+    const auto decide = [&] (ltl_processor& processor) {
+      const auto start_proc = [&] (bool real, unreal_x_t unreal_x,
+                                   const portfolio_config* conf = nullptr) {
+        if (fork () == 0) {
+          utils::vout.set_prefix (std::string {"["}
+                                  + (real ?
+                                     "real" :
+                                     std::string {"unreal-x="} + (char) unreal_x)
+                                  + (conf ? " " + conf->name : "")
+                                  + "] ");
+          if (conf)
+            apply_portfolio_config (*conf);
+          check_real = real;
+          if (!real) {
+            synth_fname = ""; // no synthesis for the environment if the formula is unrealizable
+          }
+          opt_unreal_x = unreal_x;
+          int res = 0;
+          try {
+            res = processor.run ();
+          } catch (const utils::cancelled&) {
+            verb_do (1, vout << "cancelled\n");
+            exit (3);
+          }
+          verb_do (1, vout << "returning " << (res ? 1 - real : 3) << "\n");
+          exit (res ? 1 - real : 3);  // 0 if real, 1 if unreal, 3 if unknown
+        }
+      };
 
-    int ret;
-    while (wait (&ret) != -1) { // as long as we have children to wait for
-      if (not WIFEXITED (ret)) {
-        std::cout << "ERROR: A child died unexepectedly";
-        if (WIFSIGNALED (ret))
-          std::cout << " with signal " << WTERMSIG (ret);
-        std::cout << std::endl;
-        terminate (0);
-        abort ();
+      for (auto& conf : portfolio)
+        resolve_portfolio_config (conf);
+
+      setpgid (0, 0);
+      assert (getpgid (0) == getpid ());
+
+      // the processes checking unrealizability translate other formulas, so
+      // they start before those of realizability are translated
+      if (opt_check == CHECK_BOTH or opt_check == CHECK_UNREAL) {
+        if (opt_unreal_x == UNREAL_X_BOTH or opt_unreal_x == UNREAL_X_FORMULA)
+          start_proc (false, UNREAL_X_FORMULA);
+        if (opt_unreal_x == UNREAL_X_BOTH or opt_unreal_x == UNREAL_X_AUTOMATON)
+          start_proc (false, UNREAL_X_AUTOMATON);
       }
 
-      ret = WEXITSTATUS (ret);
-      if (ret < 3) {
+      if (opt_check == CHECK_BOTH or opt_check == CHECK_REAL) {
+        // the processes checking realizability all translate the same formulas
+        if (portfolio.size () > 1)
+          processor.translate_for_real ();
+        if (portfolio.empty ())
+          start_proc (true, UNREAL_X_BOTH);
+        for (const auto& conf : portfolio)
+          start_proc (true, UNREAL_X_BOTH, &conf);
+      }
+
+      // stop the other processes, and unlink the shared memory segments they
+      // may have left behind
+      const auto stop_others = [] () {
         terminate (0);
-        if (ret == 0)
-          std::cout << "REALIZABLE\n";
-        else
-          std::cout << "UNREALIZABLE\n";
-        return ret;
+        pipe_t::discard_group_segments (getpid ());
+      };
+
+      int ret;
+      while (wait (&ret) != -1) { // as long as we have children to wait for
+        if (not WIFEXITED (ret)) {
+          std::cout << "ERROR: A child died unexepectedly";
+          if (WIFSIGNALED (ret))
+            std::cout << " with signal " << WTERMSIG (ret);
+          std::cout << std::endl;
+          stop_others ();
+          abort ();
+        }
+
+        ret = WEXITSTATUS (ret);
+        if (ret < 3) {
+          stop_others ();
+          return ret;
+        }
       }
-    }
-    std::cout << "UNKNOWN\n";
-    return 3;
+      stop_others ();
+      return 3;
+    };
+
+    if (not batch_fname.empty ())
+      return run_batch ([&] (const std::string& entry) {
+        // the entry's own flag, the one terminate () sets once the entry has a
+        // verdict: the flag of the batch, which stops it, is left alone
+        utils::cancel_flags.emplace_back ();
+        utils::cancel_flags.back ().create ();
+
+        auto args = split_entry (entry);
+        std::vector<char*> entry_argv { argv[0] };
+        for (auto& arg : args)
+          entry_argv.push_back (arg.data ());
+        entry_argv.push_back (nullptr);
+
+        // the lists built by repeated options replace those of the command line
+        auto default_inputs = std::exchange (input_aps, {});
+        auto default_outputs = std::exchange (output_aps, {});
+        auto default_init = std::exchange (init_state, {});
+        auto default_portfolio = std::exchange (portfolio, {});
+
+        jobs.clear ();
+        batch_fname.clear ();
+        in_batch_entry = true;
+        if (int err = argp_parse (&ap, entry_argv.size () - 1, entry_argv.data (),
+                                  ARGP_NO_HELP, nullptr, nullptr))
+          return err;
+        if (not batch_fname.empty ())
+          error (3, 0, "batch entries cannot start batches.");
+        // check_no_formula () would read the standard input instead
+        if (jobs.empty ())
+          error (3, 0, "batch entry without formula: %s", entry.c_str ());
+
+        if (input_aps.empty ())
+          input_aps = std::move (default_inputs);
+        if (output_aps.empty ())
+          output_aps = std::move (default_outputs);
+        if (init_state.empty ())
+          init_state = std::move (default_init);
+        if (portfolio.empty ())
+          portfolio = std::move (default_portfolio);
+        adjust_K ();
+
+        ltl_processor processor (trans, input_aps, output_aps, dict);
+        int ret = decide (processor);
+        return ret == 3 ? BATCH_UNKNOWN : ret;
+      });
+
+    adjust_K ();
+    ltl_processor processor (trans, input_aps, output_aps, dict);
+    int ret = decide (processor);
+    if (ret == 0)
+      std::cout << "REALIZABLE\n";
+    else if (ret == 1)
+      std::cout << "UNREALIZABLE\n";
+    else
+      std::cout << "UNKNOWN\n";
+    return ret;
   });
 }
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <algorithm>
+#include <compare>
+#include <numeric>
+#include <ranges>
+#include <unordered_map>
+#include <vector>
+
+#ifndef NO_SIMD
+# include <experimental/simd>
+#endif
+
+#include <posets/utils/vector_mm.hh>
+
+namespace actioners {
+  namespace detail {
+    inline void hash_combine (size_t& h, size_t v) {
+      h ^= v + 0x9e3779b97f4a7c15ul + (h << 6) + (h >> 2);
+    }
+
+    struct ids_hasher {
+        template <typename T>
+        size_t operator() (const std::vector<T>& ids) const {
+          size_t h = ids.size ();
+          for (auto id : ids)
+            hash_combine (h, id);
+          return h;
+        }
+    };
+
+    /// \brief Scratch space for csr_action::apply_batch.
+    ///
+    /// A block of block_size vectors is stored state-major (structure of
+    /// arrays): the component q of the j-th vector is at q * block_size + j, so
+    /// that applying one transition to the whole block is a loop over
+    /// contiguous memory.
+    struct block_arena {
+        static constexpr size_t block_size = 64;
+        std::vector<VECTOR_ELT_T> in, out;
+        posets::utils::vector_mm<VECTOR_ELT_T> column;
+    };
+
+    /// \brief The transitions compatible with one IO, in compressed sparse
+    /// row form.
+    ///
+    /// The predecessors of q are preds[pred_offsets[q] .. pred_offsets[q + 1]),
+    /// and the successors of p are succs[succ_offsets[p] .. succ_offsets[p + 1]);
+    /// both are sorted, so that two actions with the same transitions compare
+    /// equal.  succ_acc[i] is 1 if succs[i] is accepting, 0 otherwise, so that
+    /// the backward application never looks up the acceptance of a state.
+    struct csr_action {
+        csr_action () = default;
+
+        // transitions is a range of (p, q) pairs, each being a transition
+        // p -> q; accepting[q] is 1 if q is accepting, 0 otherwise.
+        template <typename Transitions>
+        csr_action (size_t nstates, const Transitions& transitions,
+                    const std::vector<VECTOR_ELT_T>& accepting) :
+          pred_offsets (nstates + 1, 0), succ_offsets (nstates + 1, 0) {
+          for (const auto& [p, q] : transitions) {
+            ++pred_offsets[q + 1];
+            ++succ_offsets[p + 1];
+          }
+          std::partial_sum (pred_offsets.begin (), pred_offsets.end (), pred_offsets.begin ());
+          std::partial_sum (succ_offsets.begin (), succ_offsets.end (), succ_offsets.begin ());
+
+          preds.resize (pred_offsets.back ());
+          succs.resize (succ_offsets.back ());
+          auto pred_pos = pred_offsets, succ_pos = succ_offsets;
+          for (const auto& [p, q] : transitions) {
+            preds[pred_pos[q]++] = p;
+            succs[succ_pos[p]++] = q;
+          }
+
+          for (size_t q = 0; q < nstates; ++q) {
+            std::sort (preds.begin () + pred_offsets[q], preds.begin () + pred_offsets[q + 1]);
+            std::sort (succs.begin () + succ_offsets[q], succs.begin () + succ_offsets[q + 1]);
+          }
+
+          succ_acc.reserve (succs.size ());
+          for (auto q : succs)
+            succ_acc.push_back (accepting[q]);
+        }
+
+        size_t size () const { return pred_offsets.size () - 1; }
+
+        size_t num_transitions () const { return succs.size (); }
+
+        // Whether every transition of this action is a transition of other.
+        bool transitions_included_in (const csr_action& other) const {
+          if (num_transitions () > other.num_transitions ())
+            return false;
+          for (size_t p = 0; p < size (); ++p)
+            if (not std::includes (other.succs.begin () + other.succ_offsets[p],
+                                   other.succs.begin () + other.succ_offsets[p + 1],
+                                   succs.begin () + succ_offsets[p],
+                                   succs.begin () + succ_offsets[p + 1]))
+              return false;
+          return true;
+        }
+
+        // out[q] = max over p -> q with m[p] != -1 of min (K, m[p] + accepting[q]),
+        // or -1 if there is no such p.
+        template <typename State>
+        void apply_forward (const State& m, VECTOR_ELT_T K,
+                            const std::vector<VECTOR_ELT_T>& accepting,
+                            posets::utils::vector_mm<VECTOR_ELT_T>& out) const {
+          const size_t n = size ();
+          // Since min (K, . + accepting[q]) is monotone, gather the max first.
+          for (size_t q = 0; q < n; ++q) {
+            VECTOR_ELT_T best = -1;
+            for (auto i = pred_offsets[q]; i < pred_offsets[q + 1]; ++i) {
+              best = std::max (best, (VECTOR_ELT_T) m[preds[i]]);
+              if (best == K) // Extreme value reached.
+                break;
+            }
+            out[q] = best;
+          }
+
+          VECTOR_ELT_T* o = &out[0];
+          const VECTOR_ELT_T* acc = accepting.data ();
+          size_t q = 0;
+#ifndef NO_SIMD
+          namespace stdx = std::experimental;
+          using simd_t = stdx::native_simd<VECTOR_ELT_T>;
+          const simd_t minus_one (-1), vK (K);
+          for (; q + simd_t::size () <= n; q += simd_t::size ()) {
+            simd_t b (o + q, stdx::element_aligned), a (acc + q, stdx::element_aligned);
+            simd_t r = stdx::min (vK, b + a);
+            stdx::where (b == minus_one, r) = minus_one;
+            r.copy_to (o + q, stdx::element_aligned);
+          }
+#endif
+          for (; q < n; ++q)
+            if (o[q] != -1)
+              o[q] = std::min (K, (VECTOR_ELT_T) (o[q] + acc[q]));
+        }
+
+        // out[p] = min (reset[p], min over p -> q of max (-1, m[q] - accepting[q])).
+        template <typename State>
+        void apply_backward (const State& m,
+                             const posets::utils::vector_mm<VECTOR_ELT_T>& reset,
+                             posets::utils::vector_mm<VECTOR_ELT_T>& out) const {
+          const size_t n = size ();
+          // max (-1, .) is monotone and reset >= -1, so the clamping to -1 is
+          // done once, after the gather.
+          for (size_t p = 0; p < n; ++p) {
+            VECTOR_ELT_T best = reset[p];
+            for (auto i = succ_offsets[p]; i < succ_offsets[p + 1]; ++i) {
+              best = std::min (best, (VECTOR_ELT_T) (m[succs[i]] - succ_acc[i]));
+              if (best < 0) // Will be clamped to -1 or is -1 already.
+                break;
+            }
+            out[p] = best;
+          }
+
+          VECTOR_ELT_T* o = &out[0];
+          size_t p = 0;
+#ifndef NO_SIMD
+          namespace stdx = std::experimental;
+          using simd_t = stdx::native_simd<VECTOR_ELT_T>;
+          const simd_t minus_one (-1);
+          for (; p + simd_t::size () <= n; p += simd_t::size ()) {
+            simd_t b (o + p, stdx::element_aligned);
+            stdx::max (minus_one, b).copy_to (o + p, stdx::element_aligned);
+          }
+#endif
+          for (; p < n; ++p)
+            o[p] = std::max ((VECTOR_ELT_T) -1, o[p]);
+        }
+
+        // Apply this action in direction dir to every vector of the range ms,
+        // calling emit on each image, in order; reset is the initial value of
+        // the backward images.  The vectors are processed by blocks stored in
+        // arena, see block_arena.
+        template <typename States, typename Emit>
+        void apply_batch (const States& ms, direction dir, VECTOR_ELT_T K,
+                          const std::vector<VECTOR_ELT_T>& accepting,
+                          const posets::utils::vector_mm<VECTOR_ELT_T>& reset,
+                          block_arena& arena, Emit&& emit) const {
+          constexpr size_t B = block_arena::block_size;
+          const size_t n = size ();
+          arena.in.resize (n * B);
+          arena.out.resize (n * B);
+          if (arena.column.size () != n)
+            arena.column = posets::utils::vector_mm<VECTOR_ELT_T> (n);
+
+          auto it = std::ranges::begin (ms);
+          const auto end = std::ranges::end (ms);
+          while (it != end) {
+            size_t b = 0;
+            for (; b < B and it != end; ++b, ++it) {
+              const auto& m = *it;
+              for (size_t q = 0; q < n; ++q)
+                arena.in[q * B + b] = m[q];
+            }
+
+            if (dir == direction::forward)
+              forward_block (arena.in.data (), K, accepting, arena.out.data ());
+            else
+              backward_block (arena.in.data (), reset, arena.out.data ());
+
+            for (size_t j = 0; j < b; ++j) {
+              for (size_t q = 0; q < n; ++q)
+                arena.column[q] = arena.out[q * B + j];
+              emit (arena.column);
+            }
+          }
+        }
+
+        auto operator<=> (const csr_action&) const = default;
+        bool operator== (const csr_action&) const = default;
+
+        struct hasher {
+            size_t operator() (const csr_action& a) const {
+              size_t h = ids_hasher () (a.succ_offsets);
+              hash_combine (h, ids_hasher () (a.succs));
+              return h;
+            }
+        };
+
+      private:
+        // Block versions of apply_forward and apply_backward; in and out are
+        // laid out as in block_arena.
+        void forward_block (const VECTOR_ELT_T* in, VECTOR_ELT_T K,
+                            const std::vector<VECTOR_ELT_T>& accepting,
+                            VECTOR_ELT_T* out) const {
+          constexpr size_t B = block_arena::block_size;
+          for (size_t q = 0; q < size (); ++q) {
+            VECTOR_ELT_T* o = out + q * B;
+            std::fill_n (o, B, (VECTOR_ELT_T) -1);
+            for (auto i = pred_offsets[q]; i < pred_offsets[q + 1]; ++i) {
+              const VECTOR_ELT_T* x = in + preds[i] * B;
+              size_t j = 0;
+#ifndef NO_SIMD
+              namespace stdx = std::experimental;
+              using simd_t = stdx::native_simd<VECTOR_ELT_T>;
+              for (; j + simd_t::size () <= B; j += simd_t::size ())
+                stdx::max (simd_t (o + j, stdx::element_aligned),
+                           simd_t (x + j, stdx::element_aligned)).copy_to (o + j, stdx::element_aligned);
+#endif
+              for (; j < B; ++j)
+                o[j] = std::max (o[j], x[j]);
+            }
+
+            const VECTOR_ELT_T acc = accepting[q];
+            size_t j = 0;
+#ifndef NO_SIMD
+            namespace stdx = std::experimental;
+            using simd_t = stdx::native_simd<VECTOR_ELT_T>;
+            const simd_t minus_one (-1), vK (K), vacc (acc);
+            for (; j + simd_t::size () <= B; j += simd_t::size ()) {
+              simd_t b (o + j, stdx::element_aligned);
+              simd_t r = stdx::min (vK, b + vacc);
+              stdx::where (b == minus_one, r) = minus_one;
+              r.copy_to (o + j, stdx::element_aligned);
+            }
+#endif
+            for (; j < B; ++j)
+              if (o[j] != -1)
+                o[j] = std::min (K, (VECTOR_ELT_T) (o[j] + acc));
+          }
+        }
+
+        void backward_block (const VECTOR_ELT_T* in,
+                             const posets::utils::vector_mm<VECTOR_ELT_T>& reset,
+                             VECTOR_ELT_T* out) const {
+          constexpr size_t B = block_arena::block_size;
+          for (size_t p = 0; p < size (); ++p) {
+            VECTOR_ELT_T* o = out + p * B;
+            std::fill_n (o, B, (VECTOR_ELT_T) reset[p]);
+            for (auto i = succ_offsets[p]; i < succ_offsets[p + 1]; ++i) {
+              const VECTOR_ELT_T* x = in + succs[i] * B;
+              const VECTOR_ELT_T acc = succ_acc[i];
+              size_t j = 0;
+#ifndef NO_SIMD
+              namespace stdx = std::experimental;
+              using simd_t = stdx::native_simd<VECTOR_ELT_T>;
+              const simd_t vacc (acc);
+              for (; j + simd_t::size () <= B; j += simd_t::size ())
+                stdx::min (simd_t (o + j, stdx::element_aligned),
+                           simd_t (x + j, stdx::element_aligned) - vacc).copy_to (o + j, stdx::element_aligned);
+#endif
+              for (; j < B; ++j)
+                o[j] = std::min (o[j], (VECTOR_ELT_T) (x[j] - acc));
+            }
+
+            size_t j = 0;
+#ifndef NO_SIMD
+            namespace stdx = std::experimental;
+            using simd_t = stdx::native_simd<VECTOR_ELT_T>;
+            const simd_t minus_one (-1);
+            for (; j + simd_t::size () <= B; j += simd_t::size ())
+              stdx::max (minus_one, simd_t (o + j, stdx::element_aligned)).copy_to (o + j, stdx::element_aligned);
+#endif
+            for (; j < B; ++j)
+              o[j] = std::max ((VECTOR_ELT_T) -1, o[j]);
+          }
+        }
+
+        std::vector<unsigned> pred_offsets, preds;
+        std::vector<unsigned> succ_offsets, succs;
+        std::vector<VECTOR_ELT_T> succ_acc;
+    };
+
+    /// \brief A reference to an action stored in an action_table.
+    ///
+    /// Two references are equal iff the actions are, and ids are consecutive
+    /// from 0, so that they can index per-action data.
+    struct action_ref {
+        unsigned id;
+        const csr_action* action;
+
+        operator const csr_action& () const { return *action; }
+
+        size_t num_transitions () const { return action->num_transitions (); }
+
+        bool transitions_included_in (const action_ref& other) const {
+          return action->transitions_included_in (*other.action);
+        }
+
+        auto operator<=> (const action_ref& rhs) const { return id <=> rhs.id; }
+        bool operator== (const action_ref& rhs) const { return id == rhs.id; }
+    };
+
+    /// \brief Hash-consing table of actions: each distinct action is stored
+    /// once, and gets an id.
+    class action_table {
+      public:
+        action_ref intern (csr_action&& action) {
+          // try_emplace does not move from action if it is already present.
+          auto [it, _] = table.try_emplace (std::move (action), (unsigned) table.size ());
+          return { it->second, &it->first };
+        }
+
+        size_t size () const { return table.size (); }
+
+      private:
+        // References to the elements of an unordered_map are stable.
+        std::unordered_map<csr_action, unsigned, csr_action::hasher> table;
+    };
+  }
+}
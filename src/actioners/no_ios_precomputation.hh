@@ -1,43 +1,30 @@
 #pragma once
 
+#include "actioners/csr_action.hh"
+
 namespace actioners {
   namespace detail {
     template <typename State, typename Aut, typename Supports>
     class no_ios_precomputation {
       public: // types
-        using action = std::vector<std::pair<unsigned, bool>>; // All these pairs are unique by construction.
-        using action_vec = std::vector<action>;          // Vector indexed by state number
+        using action_vec = csr_action;
         using action_vecs = std::list<action_vec>;
         using input_and_actions = std::pair<bdd, action_vecs>;
         struct compare_actions {
-            // WORST: all code with not
             bool operator() (const input_and_actions& x, const input_and_actions& y) const {
               return (x.second < y.second);
-              // Let's favor the actions with the most potential for -1.
-              auto num_accepting_of = [this] (const action_vecs& x) {
-                int num_accepting = 0;
-                for (const auto& tav : x)
-                  for (const auto& ta : tav)
-                    for (const auto& [_, accepting] : ta)
-                      if (accepting) num_accepting++;
-                return num_accepting;
-              };
-
-              auto x_acc = num_accepting_of (x.second),
-                y_acc = num_accepting_of (y.second);
-
-              if (x_acc < y_acc)
-                return not true;
-              if (x_acc > y_acc)
-                return not false;
-              return not (x.second < y.second);
             }
         };
         using input_and_actions_set = std::list<input_and_actions>;
       public:
         no_ios_precomputation (const Aut& aut, const Supports& supports, int K) :
           aut {aut}, K {K},
-          apply_out (aut->num_states ()) {
+          apply_out (aut->num_states ()), backward_reset (aut->num_states ()) {
+
+          accepting.reserve (aut->num_states ());
+          for (size_t q = 0; q < aut->num_states (); ++q)
+            accepting.push_back (aut->state_is_accepting (q) ? 1 : 0);
+          setK (K);
 
           std::map<action_vecs, bdd> ioset;
           bdd input_letters = bddtrue;
@@ -59,60 +46,63 @@ namespace actioners {
           }
         }
 
-        void setK (int newK) { K = newK; }
+        void setK (int newK) {
+          K = newK;
+          // Non boolean
+          std::fill_n (backward_reset.begin (),
+                       posets::vectors::bool_threshold,
+                       (VECTOR_ELT_T) (K - 1));
+          // Boolean
+          std::fill_n (backward_reset.begin () + posets::vectors::bool_threshold,
+                       aut->num_states () - posets::vectors::bool_threshold,
+                       (VECTOR_ELT_T) 0);
+        }
 
         auto& actions () { return input_output_fwd_actions; }
 
         State apply (const State& m, const action_vec& avec, direction dir) /* __attribute__((pure)) */ {
-          if (dir == direction::forward)
-            apply_out.assign (m.size (), (VECTOR_ELT_T) -1);
-          else {
-            // Non boolean
-            std::fill_n (apply_out.begin (),
-                         posets::vectors::bool_threshold,
-                         (VECTOR_ELT_T) (K - 1));
-            // Boolean
-            std::fill_n (apply_out.begin () + posets::vectors::bool_threshold,
-                         m.size () - posets::vectors::bool_threshold,
-                         (VECTOR_ELT_T) 0);
-          }
-
-          for (size_t p = 0; p < m.size (); ++p) {
-            for (const auto& [q, q_final] : avec[p]) {
-              if (dir == direction::forward) {
-                if (m[q] != -1)
-                  apply_out[p] = std::max (apply_out[p], std::min ((VECTOR_ELT_T) K, (VECTOR_ELT_T) (m[q] + (VECTOR_ELT_T) (q_final ? 1 : 0))));
-              } else
-                if (apply_out[q] != -1)
-                  apply_out[q] = std::min (apply_out[q], std::max ((VECTOR_ELT_T) -1, (VECTOR_ELT_T) (m[p] - (VECTOR_ELT_T) (q_final ? 1 : 0))));
+          return apply (m, avec, dir, apply_out);
+        }
 
-              // If we reached the extreme value, stop going through states.
-              if (dir == direction::forward && apply_out[p] == K)
-                break;
-            }
-          }
+        State apply (const State& m, const action_vec& avec, direction dir,
+                     posets::utils::vector_mm<VECTOR_ELT_T>& apply_out) const {
+          if (dir == direction::forward)
+            avec.apply_forward (m, (VECTOR_ELT_T) K, accepting, apply_out);
+          else
+            avec.apply_backward (m, backward_reset, apply_out);
 
           return State (apply_out);
         }
 
+        // Apply avec to every element of the range ms, appending the images to
+        // out; arena is the caller's scratch space.  This processes the elements
+        // by blocks, see block_arena.
+        template <typename States>
+        void apply_batch (const States& ms, const action_vec& avec, direction dir,
+                          std::vector<State>& out, block_arena& arena) const {
+          avec.apply_batch (ms, dir, (VECTOR_ELT_T) K, accepting, backward_reset, arena,
+                              [&out] (const auto& column) { out.push_back (State (column)); });
+        }
+
       private:
         const Aut& aut;
         int K;
-        posets::utils::vector_mm<VECTOR_ELT_T> apply_out;
+        posets::utils::vector_mm<VECTOR_ELT_T> apply_out, backward_reset;
+        std::vector<VECTOR_ELT_T> accepting; // 1 if the state is accepting, 0 otherwise
         input_and_actions_set input_output_fwd_actions;
 
         auto compute_action (bdd letter) {
-          action_vec ret_fwd (aut->num_states ());
+          std::vector<std::pair<unsigned, unsigned>> transitions;
 
           for (size_t p = 0; p < aut->num_states (); ++p) {
             for (const auto& e : aut->out (p)) {
               unsigned q = e.dst;
               if ((e.cond & letter) != bddfalse) {
-                ret_fwd[q].push_back (std::make_pair (p, aut->state_is_accepting (q)));
+                transitions.emplace_back (p, q);
               }
             }
           }
-          return ret_fwd;
+          return action_vec (aut->num_states (), transitions, accepting);
         }
         static bdd pick_one_letter (bdd& letter_set, const bdd& support) {
           bdd one_letter = bdd_satoneset (letter_set,
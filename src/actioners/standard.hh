@@ -1,85 +1,48 @@
 #pragma once
 
+#include <cstdint>
+#include <unordered_set>
+
+#include "actioners/csr_action.hh"
+
 namespace actioners {
   namespace detail {
     template <typename State, typename Aut, typename IToIOs, bool include_IOs>
     class standard {
       public: // types
 
-        using action = std::vector<std::pair<unsigned, bool>>; // All these pairs are unique by construction.
-        using action_vec_default = std::vector<action>;        // Vector indexed by state number
-
-        // store action vector per state + IO
-        struct action_vec_IO {
-          action_vec_default actions; // index by state number q to get a vector of (p, is_q_accepting) tuples
-          bdd IO; // the IO compatible with the input that yielded this action vector
-
-          action_vec_IO () = default;
-
-          explicit action_vec_IO (size_t size) : IO (bddfalse) {
-            actions.resize (size);
-          }
+        // store action per IO
+        struct action_vec_IO : action_ref {
+          bdd IO; // the IO compatible with the input that yielded this action
 
-          auto begin () const {
-            return actions.begin ();
-          }
-
-          auto end () const {
-            return actions.end ();
-          }
-
-          auto& operator[] (size_t i) {
-            return actions[i];
-          }
-
-          const auto& operator[] (size_t i) const {
-            return actions[i];
-          }
+          action_vec_IO (action_ref action, bdd IO) : action_ref (action), IO (IO) {}
 
           bool operator<(const action_vec_IO& rhs) const {
-            return (IO.id () < rhs.IO.id ()) || ((IO.id () == rhs.IO.id ()) && (actions < rhs.actions));
-          }
-
-          size_t size () const {
-            return actions.size ();
+            return (IO.id () < rhs.IO.id ()) ||
+              ((IO.id () == rhs.IO.id ()) && (id < rhs.id));
           }
         };
 
-        // use the struct with the IO if include_IOs is true, otherwise use the normal action vector type
-        using action_vec = std::conditional <include_IOs, action_vec_IO, action_vec_default>::type;
+        // use the struct with the IO if include_IOs is true, otherwise use the plain action type;
+        // in both cases, the action itself is stored once in action_tbl.
+        using action_vec = std::conditional <include_IOs, action_vec_IO, action_ref>::type;
 
         using action_vecs = std::list<action_vec>;
         using input_and_actions = std::pair<bdd, action_vecs>;
-        struct compare_actions {
-            // WORST: all code with not
-            bool operator() (const input_and_actions& x, const input_and_actions& y) const {
-              return (x.second < y.second);
-              // Let's favor the actions with the most potential for -1.
-              auto num_accepting_of = [this] (const action_vecs& x) {
-                int num_accepting = 0;
-                for (const auto& tav : x)
-                  for (const auto& ta : tav)
-                    for (const auto& [_, accepting] : ta)
-                      if (accepting) num_accepting++;
-                return num_accepting;
-              };
-
-              auto x_acc = num_accepting_of (x.second),
-                y_acc = num_accepting_of (y.second);
-
-              if (x_acc < y_acc)
-                return not true;
-              if (x_acc > y_acc)
-                return not false;
-              return not (x.second < y.second);
-            }
-        };
         using input_and_actions_set = std::list<input_and_actions>;
+
+        struct pruning_stats_t {
+          size_t duplicate = 0, dominated = 0;
+        };
       public:
         standard (const Aut& aut, const IToIOs& inputs_to_ios, int K) :
           aut {aut}, K {(VECTOR_ELT_T) K},
           apply_out (aut->num_states ()), backward_reset (aut->num_states ()) {
 
+          accepting.reserve (aut->num_states ());
+          for (size_t q = 0; q < aut->num_states (); ++q)
+            accepting.push_back (aut->state_is_accepting (q) ? 1 : 0);
+
 	  // Non boolean
           std::fill_n (backward_reset.begin (),
                        posets::vectors::bool_threshold,
@@ -89,7 +52,10 @@ namespace actioners {
                        aut->num_states () - posets::vectors::bool_threshold,
                        (VECTOR_ELT_T) 0);
 
-          std::set<input_and_actions, compare_actions> ioset;
+          // The ids of the actions of the inputs seen so far (and their IOs,
+          // if included), sorted; inputs with the same actions are equivalent,
+          // and only the first one is kept.
+          std::unordered_set<std::vector<uint64_t>, ids_hasher> ioset;
 
           // inputs_to_ios: a map [input i, set of sets of pairs (p, q)].  Each set of pairs (p, q)
           // corresponds to an i-compatible IO x in the natural way; that is, it is the set
@@ -99,26 +65,32 @@ namespace actioners {
             // input: bdd
             // ios: set of pairs of (sets (p, q) and IO)
             std::list<action_vec> fwd_actions;
-            // action_vec : vector<vector<pair<unsigned int, bool>>>
             for (const auto& transset : ios) {
               // transset: transitions_io_pair (stores vector<pair<p, q>> and IO)
-              // turn this into a vector that maps q to a list of tuples (p, is_q_accepting) and keep the IO
-              // insert this map for every transset
+              // turn this into a csr_action and keep the IO
               fwd_actions.push_back (compute_action_vec (transset));
               // type that is being inserted: action_vec (ios_precomputers/standard.hh)
               // with current configuration.hh at the time of writing
             }
-            // per input: list (one element per compatible IO) of actions
-            // what is being inserted = pair<bdd, action_vec> with current configuration.hh at the time of writing
-            ioset.insert (std::pair (input, std::move (fwd_actions)));
-          }
+            // The IOs are needed for synthesis, so the actions can only be
+            // pruned when they are not kept.
+            if constexpr (not include_IOs)
+              prune_dominated (fwd_actions);
+            std::vector<uint64_t> ids;
+            ids.reserve (fwd_actions.size ());
+            for (const auto& a : fwd_actions) {
+              if constexpr (include_IOs)
+                ids.push_back (((uint64_t) a.IO.id () << 32) | a.id);
+              else
+                ids.push_back (a.id);
+            }
+            std::ranges::sort (ids);
 
-          for (auto it = ioset.begin(); it != ioset.end(); ) {
             // what is being inserted:
-            // pair<bdd, list<vector<vector<pair<unsigned int, bool>>>>>
+            // pair<bdd, list<action_vec>>
             // -> for every input, a list (one per compatible IO) of actions
-            // where an action maps each state q to a list of (p, is_q_accepting) tuples
-            input_output_fwd_actions.push_back (std::move (ioset.extract (it++).value ()));
+            if (ioset.insert (std::move (ids)).second)
+              input_output_fwd_actions.emplace_back (input, std::move (fwd_actions));
           }
         }
 
@@ -131,54 +103,83 @@ namespace actioners {
 
         auto& actions () { return input_output_fwd_actions; }
 
+        const auto& pruning_stats () const { return pruned; }
+
+        size_t num_distinct_actions () const { return action_tbl.size (); }
+
         State apply (const State& m, const action_vec& avec, direction dir) /* __attribute__((pure)) */ {
+          return apply (m, avec, dir, apply_out);
+        }
+
+        // Same as above, but using the scratch space apply_out given by the
+        // caller; this makes it possible to apply actions from multiple threads.
+        State apply (const State& m, const action_vec& avec, direction dir,
+                     posets::utils::vector_mm<VECTOR_ELT_T>& apply_out) const {
+          const csr_action& action = avec;
           if (dir == direction::forward)
-            apply_out.assign (m.size (), (VECTOR_ELT_T) -1);
+            action.apply_forward (m, K, accepting, apply_out);
           else
-            apply_out = backward_reset;
-
-          for (size_t p = 0; p < m.size (); ++p) {
-            for (const auto& [q, p_final] : avec[p]) {
-              if (dir == direction::forward) {
-                if (m[q] != -1)
-                  apply_out[p] = std::max (apply_out[p], std::min ((VECTOR_ELT_T) K, (VECTOR_ELT_T) (m[q] + (VECTOR_ELT_T) (p_final ? 1 : 0))));
-              } else
-                if (apply_out[q] != -1)
-                  apply_out[q] = std::min (apply_out[q], std::max ((VECTOR_ELT_T) -1, (VECTOR_ELT_T) (m[p] - (VECTOR_ELT_T) (p_final ? 1 : 0))));
-
-              // If we reached the extreme value, stop going through states.
-              if (dir == direction::forward && apply_out[p] == K)
-                break;
-            }
-          }
+            action.apply_backward (m, backward_reset, apply_out);
 
           return State (apply_out);
         }
 
+        // Apply avec to every element of the range ms, appending the images to
+        // out; arena is the caller's scratch space.  This processes the elements
+        // by blocks, see block_arena.
+        template <typename States>
+        void apply_batch (const States& ms, const action_vec& avec, direction dir,
+                          std::vector<State>& out, block_arena& arena) const {
+          const csr_action& action = avec;
+          action.apply_batch (ms, dir, K, accepting, backward_reset, arena,
+                              [&out] (const auto& column) { out.push_back (State (column)); });
+        }
+
        private:
         const Aut& aut;
         VECTOR_ELT_T K;
         posets::utils::vector_mm<VECTOR_ELT_T> apply_out, backward_reset;
+        std::vector<VECTOR_ELT_T> accepting; // 1 if the state is accepting, 0 otherwise
         input_and_actions_set input_output_fwd_actions;
+        pruning_stats_t pruned;
+        action_table action_tbl;
+
+        // Remove the actions whose transitions include those of another action,
+        // and all but one copy of the duplicate actions.  If the transitions
+        // of a are included in those of b, then for every m, the backward image
+        // of m by b is smaller than that by a, so that b never contributes to
+        // the union F1i; and the forward image by b is larger than that by a,
+        // so that it never makes the difference in deciding whether an input is
+        // critical.
+        void prune_dominated (std::list<action_vec>& actions) {
+          actions.sort ([] (const action_vec& a, const action_vec& b) {
+            return (a.num_transitions () < b.num_transitions ()) or
+              ((a.num_transitions () == b.num_transitions ()) and (a < b));
+          });
+
+          std::list<action_vec> kept;
+          for (auto& a : actions) {
+            if (not kept.empty () and kept.back () == a)
+              pruned.duplicate++;
+            else if (std::ranges::any_of (kept, [&a] (const action_vec& k) {
+                       return k.transitions_included_in (a);
+                     }))
+              pruned.dominated++;
+            else
+              kept.push_back (std::move (a));
+          }
+          actions = std::move (kept);
+        }
 
         template <typename Set>
-        auto compute_action_vec (const Set& transset) {
-
-          // create action_vec and include transset.second = the IO if needed
-          action_vec ret_fwd (aut->num_states ());
+        action_vec compute_action_vec (const Set& transset) {
+          // transset is a set of pairs (p, q), each a transition p -> q
+          // compatible with the IO transset.IO.
+          auto action = action_tbl.intern (csr_action (aut->num_states (), transset, accepting));
           if constexpr (include_IOs)
-            ret_fwd.IO = transset.IO;
-
-          TODO ("We have two representations of the same thing here; "
-                "see if we can narrow it down to one.");
-
-          // ret_fwd: vector<vector<pair<unsigned int, bool>>>
-          // first index = state q, map each state q to a list of tuples (p, is_q_accepting)
-
-          for (const auto& [p, q] : transset)
-            ret_fwd[q].push_back (std::make_pair (p, aut->state_is_accepting (q)));
-
-          return ret_fwd;
+            return action_vec (action, transset.IO);
+          else
+            return action;
         }
     };
   }
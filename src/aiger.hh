@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+#include <fstream>
 #include <vector>
 #include <string>
 #include "utils/typeinfo.hh"
@@ -228,3 +230,51 @@ class aiger {
   }
 };
 
+
+// the functions computed by synthesis: for each latch its next value, and for
+// each output its value, as functions of the inputs and the latches
+struct controller {
+  std::vector<bdd> inputs, latches, outputs;
+  std::vector<bdd> latch_funcs, output_funcs;
+};
+
+// write the circuit of controllers that run side by side: they share the
+// inputs, have their own latches, and each output is computed by one of them
+inline void write_aiger (const std::vector<controller>& ctrls, const std::string& synth_fname, spot::twa_graph_ptr aut) {
+  assert (not ctrls.empty ());
+
+  std::vector<bdd> latches;
+  std::vector<std::pair<bdd, bdd>> outputs; // (output, function)
+  for (const auto& ctrl : ctrls) {
+    latches.insert (latches.end (), ctrl.latches.begin (), ctrl.latches.end ());
+    for (size_t i = 0; i < ctrl.outputs.size (); i++)
+      outputs.emplace_back (ctrl.outputs[i], ctrl.output_funcs[i]);
+  }
+  // keep the outputs in the order of their variables
+  std::ranges::sort (outputs, {}, [] (const auto& p) { return bdd_var (p.first); });
+
+  std::vector<bdd> output_vector;
+  for (const auto& [o, g_o] : outputs)
+    output_vector.push_back (o);
+
+  aiger aig (ctrls[0].inputs, latches, output_vector, aut);
+
+  for (size_t i = 0; i < outputs.size (); i++)
+    aig.add_output (i, outputs[i].second);
+
+  int i = 0;
+  for (const auto& ctrl : ctrls)
+    for (const bdd& f_l : ctrl.latch_funcs)
+      aig.add_latch (i++, f_l);
+
+  if (synth_fname != "-") {
+    std::ofstream f (synth_fname);
+    aig.output (f, false);
+    f.close ();
+  } else {
+    utils::vout << "\n\n\n";
+    aig.output (utils::vout, true);
+  }
+
+  verb_do (1, vout << "\n\n");
+}
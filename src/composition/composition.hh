@@ -65,20 +65,16 @@ class composition {
   std::vector<unsigned int> rename;
   unsigned int aut_size = 0; // number of states in the final merged automaton
 
-  // concatenate two vectors, taking into a account a new initial state is added, + the states are renamed
-  auto combine_vectors (const auto& m1, const auto& m2) {
+  // the coordinates of m that are still there in the merged automaton, the
+  // others being 0; offset is 0 for a vector of dest, and the number of states
+  // of dest plus 1 for a vector of src
+  auto project_vector (const auto& m, size_t offset) {
     assert (aut_size > 0);
     auto vec = posets::utils::vector_mm<VECTOR_ELT_T>(aut_size, 0);
 
-    for (size_t i = 0; i < m1.size (); ++i) {
-      if (rename[i] != -1u) {
-        vec[rename[i]] = m1[i];
-      }
-    }
-
-    for (size_t i = 0; i < m2.size (); ++i) {
-      if (rename[i + m1.size () + 1] != -1u) {
-        vec[rename[i + m1.size () + 1]] = m2[i];
+    for (size_t i = 0; i < m.size (); ++i) {
+      if (rename[i + offset] != -1u) {
+        vec[rename[i + offset]] = m[i];
       }
     }
 
@@ -188,11 +184,42 @@ class composition {
 
 
 
+  // The merged safe region is the product of F1 and F2.  The two automata have
+  // disjoint sets of states, so a combined vector is dominated exactly when
+  // its parts are; F1 and F2 are thus reduced to the maximal elements of their
+  // projections on the remaining states, and the product of these is already
+  // an antichain, which is the only thing ever stored.
   auto merge_saferegions (GenericDownset& F1, GenericDownset& F2) {
+    assert (F1.size () > 0 and F2.size () > 0);
+    size_t offset = F1.begin ()->size () + 1;
+
+    std::vector<GenericDownset::value_type> proj;
+    for (const auto& m1: F1)
+      proj.push_back (project_vector (m1, 0));
+    GenericDownset P1 (std::move (proj));
+
+    proj.clear ();
+    for (const auto& m2: F2)
+      proj.push_back (project_vector (m2, offset));
+    GenericDownset P2 (std::move (proj));
+
+    // which states of the merged automaton come from src
+    std::vector<bool> from_src (aut_size, false);
+    for (size_t i = offset; i < rename.size (); ++i)
+      if (rename[i] != -1u)
+        from_src[rename[i]] = true;
+
+    verb_do (2, vout << "Merging safe regions of " << F1.size () << " and " << F2.size ()
+             /*   */ << " elements, reduced to " << P1.size () << " and " << P2.size () << "\n");
+
     std::vector<GenericDownset::value_type> elements;
-    for(const auto& m1: F1) {
-      for(const auto& m2: F2) {
-        elements.push_back (combine_vectors (m1, m2));
+    elements.reserve (P1.size () * P2.size ());
+    auto vec = posets::utils::vector_mm<VECTOR_ELT_T>(aut_size, 0);
+    for (const auto& p1: P1) {
+      for (const auto& p2: P2) {
+        for (size_t i = 0; i < aut_size; ++i)
+          vec[i] = from_src[i] ? p2[i] : p1[i];
+        elements.push_back (GenericDownset::value_type (vec));
       }
     }
     GenericDownset merged (std::move (elements));
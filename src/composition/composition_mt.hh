@@ -5,31 +5,71 @@
 #pragma once
 #include "types.hh"
 #include "composition.hh"
+#include <map>
 #include <queue>
+#include <unordered_map>
 #include <fcntl.h>
+#include <sys/epoll.h>
 #include <thread>
+#include <numeric>
+#include <spot/misc/hashfunc.hh>
+#include <spot/tl/apcollect.hh>
+#include <spot/tl/print.hh>
 #include <spot/twaalgos/translate.hh>
 #include "pipes.hh"
+#include "game_cache.hh"
+#include "../strategies.hh"
+#include "../utils/cancel.hh"
 
 
 class job_base;
 
 using job_ptr = std::shared_ptr<job_base>;
 
+// number of states of a game, used to merge the smallest games first
+inline size_t game_size (const safety_game& g) {
+  return g.aut ? g.aut->num_states () : 0;
+}
+
+// what a worker sends back for a job
+struct job_result {
+  result_type type = r_null;
+  safety_game game; // for r_game
+  bdd condition;    // for r_invariant
+};
+
 struct worker_t {
   // two pipes, for communication in both directions
   pipe_t to_main, from_main;
   pid_t pid = -1;
   bool active = true; // whether the worker has already stopped
+  job_ptr job; // the job the worker is doing
 };
 
 class composition_mt {
+  public:
+  using translations_t = std::map<spot::formula, spot::twa_graph_ptr>; // automata by formula
+
   private:
   std::queue<job_ptr> pending_jobs; // all currently unfinished jobs no worker is working on yet
-  std::shared_ptr<safety_game> stored_result; // room for temporary result: if there are 2, merge them
+  // solved games that are not merged yet, the smallest one on top
+  struct larger_game {
+    bool operator() (const std::shared_ptr<safety_game>& a, const std::shared_ptr<safety_game>& b) const {
+      return game_size (*a) > game_size (*b);
+    }
+  };
+  using result_pool = std::priority_queue<std::shared_ptr<safety_game>, std::vector<std::shared_ptr<safety_game>>, larger_game>;
+  std::vector<result_pool> results; // one pool per component, each merged into one game
+
+  // the formulas, and for each component the output APs its formulas use;
+  // components share no outputs, so they are solved as separate games
+  std::vector<spot::formula> formulas;
+  std::vector<std::vector<std::string>> component_outputs;
   bool losing = false; // whether the game is already found to be losing (early abort)
+  bool interrupted = false; // whether the whole computation was cancelled from outside
+  utils::cancel_flag stop_flag; // set to make the workers stop their jobs once the game is losing
+  game_cache cache; // results of formula and solve jobs from previous runs, if enabled
 
-  pipe_t shared_pipe; // pipe that all workers use to write a byte to to signify they are done with their job
   std::vector<worker_t> workers;
 
   bdd invariant = bddtrue;
@@ -43,24 +83,31 @@ class composition_mt {
   std::vector<std::string> output_aps_;
 
   std::vector<int> init_state;
-
+  strategies::choice strategy;
+  translations_t translations; // automata translated before this process was forked
 
   spot::formula bdd_to_formula (bdd f) const; // for debugging
   void enqueue (job_ptr p); // add a new job to the queue
   job_ptr dequeue (); // take a job from the pending jobs queue
+  job_ptr next_job (); // take a pending job, or else a merge of the two smallest results
 
   void add_invariant (bdd inv); // add a new invariant
   void finish_invariant (); // turns the invariant into a solved 2-state automaton, not used right now because the ios-precomputer uses the invariant
   void solve_game (safety_game& game); // use the k-bounded safety aut to solve a game
   int epilogue (std::string synth_fname, std::string winreg_fname); // look at the final result, call synthesis if needed and return whether it was realizable
   void be_child (int id); // does everything a child process has to do
-  void add_result (safety_game& r); // add a new result to the temporary, or add a merge if there is already one stored
+  void add_result (safety_game& r, int c); // add a new solved game to the results of component c to be merged
+  void split_components (bool split); // group the formulas by shared outputs and add their jobs
+  void write_result (pipe_t& pipe, job_result& res); // write the result of a job as one message
+  job_result read_result (pipe_t& pipe); // read a message written by write_result
 
   using aut_t = decltype (trans_.run (spot::formula::ff ()));
   aut_t push_outputs (const aut_t& aut, bdd all_inputs, bdd all_outputs);
   safety_game prepare_formula (spot::formula f, bool check_real = true, unreal_x_t opt_unreal_x = UNREAL_X_BOTH); // turn a formula into an automaton
 
   public:
+  static spot::twa_graph_ptr translate (spot::translator& trans, spot::formula f); // the Büchi automaton of f, as all formulas are translated
+
   composition_mt (unsigned opt_K, unsigned opt_Kmin, unsigned opt_Kinc,
       spot::bdd_dict_ptr dict, spot::translator& trans, bdd all_inputs, bdd
       all_outputs, std::vector<std::string> input_aps_,
@@ -69,7 +116,10 @@ class composition_mt {
     trans_(trans), all_inputs(all_inputs), all_outputs(all_outputs),
     input_aps_(input_aps_), output_aps_(output_aps_), init_state(init_state) {}
 
-  void add_formula (spot::formula f); // adds a formula job
+  void add_formula (spot::formula f); // adds a formula, turned into a job by run ()
+  void set_strategies (const strategies::choice& s); // use these strategies instead of the configured ones
+  void set_translations (const translations_t& t); // use these automata instead of translating their formulas
+  void set_cache_dir (const std::string& dir); // keep the results of formula and solve jobs in this directory
   int run (int workers, std::string synth_fname, std::string winreg_fname); // run everything with the given number of workers
   int run_one (spot::formula f, std::string synth_fname, std::string winreg_fname, bool check_real, unreal_x_t opt_unreal_x); // solve only one formula, with no subprocesses
 };
@@ -79,8 +129,11 @@ class job_base {
   public:
   virtual ~job_base () = default;
 
+  int component = 0; // the component the game of the job belongs to
+
   virtual void to_pipe(pipe_t&) = 0;
   virtual void set_invariant(bdd) = 0;
+  virtual std::string cache_entry () const { return {}; } // describes the job in the cache, if it may be cached
 };
 
 // solve the safety game, changing the downset to the actual safe region instead of
@@ -89,11 +142,27 @@ class job_solve: public job_base {
   public:
   safety_game starting_point;
   bdd invariant;
+  std::string origin; // the formula the game was made from, if any
 
   public:
   explicit job_solve (safety_game& game);
   ~job_solve () override = default;
 
+  void to_pipe(pipe_t&) override;
+  void set_invariant(bdd) override;
+  std::string cache_entry () const override;
+};
+
+// merge two solved games and solve the product
+class job_merge: public job_base {
+  public:
+  safety_game left, right;
+  bdd invariant;
+
+  public:
+  job_merge (safety_game& left, safety_game& right);
+  ~job_merge () override = default;
+
   void to_pipe(pipe_t&) override;
   void set_invariant(bdd) override;
 };
@@ -109,6 +178,7 @@ class job_formula: public job_base {
 
   void to_pipe(pipe_t&) override;
   void set_invariant(bdd) override;
+  std::string cache_entry () const override;
 };
 
 //////////////////////////////////////////////////
@@ -126,6 +196,7 @@ void job_solve::to_pipe (pipe_t& pipe) {
   // sends the invariant as well to be used when solving
   pipe.write_bdd (invariant, starting_point.aut->get_dict ());
   pipe.write_safety_game (starting_point);
+  pipe.flush ();
   verb_do (1, vout << "Solve job sent: wrote " << pipe.get_bytes_count () << " bytes to pipe\n");
 }
 
@@ -133,6 +204,32 @@ void job_solve::set_invariant (bdd inv) {
   invariant = inv;
 }
 
+std::string job_solve::cache_entry () const {
+  // the safe region depends on the invariant it was solved with
+  if (origin.empty ())
+    return {};
+  return "solve " + origin + "\ninvariant " +
+    spot::str_psl (spot::bdd_to_formula (invariant, starting_point.aut->get_dict ()));
+}
+
+
+job_merge::job_merge (safety_game& left, safety_game& right): left(left), right(right) {
+  invariant = bddtrue;
+}
+
+void job_merge::to_pipe (pipe_t& pipe) {
+  pipe.write_obj<job_type> (j_merge);
+  pipe.write_bdd (invariant, left.aut->get_dict ());
+  pipe.write_safety_game (left);
+  pipe.write_safety_game (right);
+  pipe.flush ();
+  verb_do (1, vout << "Merge job sent: wrote " << pipe.get_bytes_count () << " bytes to pipe\n");
+}
+
+void job_merge::set_invariant (bdd inv) {
+  invariant = inv;
+}
+
 
 job_formula::job_formula (spot::formula f): f(f) {
 
@@ -141,6 +238,7 @@ job_formula::job_formula (spot::formula f): f(f) {
 void job_formula::to_pipe (pipe_t& pipe) {
   pipe.write_obj<job_type> (j_formula);
   pipe.write_formula (f);
+  pipe.flush ();
   verb_do (1, vout << "Formula job sent: wrote " << pipe.get_bytes_count () << " bytes to pipe\n");
 }
 
@@ -148,6 +246,10 @@ void job_formula::set_invariant (bdd) {
   // doesn't do anything
 }
 
+std::string job_formula::cache_entry () const {
+  return "formula " + spot::str_psl (f);
+}
+
 
 // detects whether a Büchi automaton recognizes an invariant, i.e. G (booleanfunction)
 bool is_invariant (spot::twa_graph_ptr aut, bdd& condition) {
@@ -205,33 +307,140 @@ job_ptr composition_mt::dequeue () {
   return val;
 }
 
-void composition_mt::add_result (safety_game& r) {
-  if (!stored_result) {
-    stored_result = std::make_shared<safety_game> (r);
+job_ptr composition_mt::next_job () {
+  // formula and solve jobs first: their results give more choice of merges
+  if (auto job = dequeue ())
+    return job;
+
+  for (size_t c = 0; c < results.size (); c++) {
+    if (results[c].size () < 2)
+      continue;
+
+    // merge the two smallest games, so that the merges form a Huffman tree
+    auto left = results[c].top ();
+    results[c].pop ();
+    auto right = results[c].top ();
+    results[c].pop ();
+    verb_do (1, vout << "Merging games with " << game_size (*left) << " and "
+             /*   */ << game_size (*right) << " states\n");
+    auto job = std::make_shared<job_merge> (*left, *right);
+    job->component = c;
+    return job;
   }
-  else {
-    // merge the stored result, and the new result r
-    safety_game inputs[2];
-    inputs[0] = *stored_result;
-    inputs[1] = r;
+  return nullptr;
+}
 
-    assert (inputs[0].safe);
-    assert (inputs[1].safe);
+void composition_mt::add_result (safety_game& r, int c) {
+  results[c].push (std::make_shared<safety_game> (r));
+}
 
-    verb_do (2, vout << "Merging " << *inputs[0].safe << " and " << *inputs[1].safe);
+void composition_mt::split_components (bool split) {
+  // union-find over the formulas, joining those that use a common output
+  std::vector<size_t> parent (formulas.size ());
+  std::iota (parent.begin (), parent.end (), 0);
+  auto find = [&] (size_t i) {
+    while (parent[i] != i)
+      i = parent[i] = parent[parent[i]];
+    return i;
+  };
+
+  std::map<std::string, size_t> user; // output AP -> some formula using it
+  std::vector<std::vector<std::string>> outputs_of (formulas.size ());
+  for (size_t i = 0; i < formulas.size (); i++) {
+    spot::atomic_prop_set aps;
+    spot::atomic_prop_collect (formulas[i], &aps);
+    for (const auto& ap : aps) {
+      if (std::ranges::find (output_aps_, ap.ap_name ()) == output_aps_.end ())
+        continue;
+      outputs_of[i].push_back (ap.ap_name ());
+      auto [it, fresh] = user.emplace (ap.ap_name (), i);
+      if (not fresh)
+        parent[find (i)] = find (it->second);
+    }
+    if (not split)
+      parent[find (i)] = find (0);
+  }
 
-    auto composer = composition ();
-    composer.merge_aut (inputs[0], inputs[1]);
-    inputs[0].safe = std::make_shared<GenericDownset> (composer.merge_saferegions (*inputs[0].safe, *inputs[1].safe));
-    inputs[0].solved = false;
+  // number the components in the order of their first formula
+  std::vector<int> component (formulas.size (), -1);
+  component_outputs.clear ();
+  for (size_t i = 0; i < formulas.size (); i++) {
+    int& c = component[find (i)];
+    if (c == -1) {
+      c = component_outputs.size ();
+      component_outputs.emplace_back ();
+    }
+    auto& outs = component_outputs[c];
+    for (const auto& o : outputs_of[i])
+      if (std::ranges::find (outs, o) == outs.end ())
+        outs.push_back (o);
+
+    auto job = std::make_shared<job_formula> (formulas[i]);
+    job->component = c;
+    enqueue (job);
+  }
 
-    assert (inputs[0].safe);
-    verb_do (2, vout << "Merge res: " << *(inputs[0].safe));
-    verb_do (1, vout << "Done with merge, adding solve job\n");
-    enqueue (std::make_shared<job_solve> (inputs[0]));
+  // outputs no formula uses are left to the first component
+  for (const auto& o : output_aps_)
+    if (not user.contains (o))
+      component_outputs[0].push_back (o);
 
-    stored_result = nullptr;
-  }
+  results.resize (component_outputs.size ());
+  verb_do (1, vout << formulas.size () << " formulas, " << component_outputs.size ()
+           /*   */ << " independent component(s)\n");
+}
+
+void composition_mt::set_strategies (const strategies::choice& s) {
+  strategy = s;
+  verb_do (1, vout << "Strategies: " << strategy.describe () << "\n");
+}
+
+void composition_mt::set_translations (const translations_t& t) {
+  translations = t;
+}
+
+void composition_mt::set_cache_dir (const std::string& dir) {
+  auto ins = input_aps_;
+  auto outs = output_aps_;
+  std::ranges::sort (ins);
+  std::ranges::sort (outs);
+
+  std::string context = "inputs";
+  for (const auto& ap : ins)
+    context += " " + ap;
+  context += "\noutputs";
+  for (const auto& ap : outs)
+    context += " " + ap;
+  context += "\nK " + std::to_string (opt_K) + " Kmin " + std::to_string (opt_Kmin) +
+    " Kinc " + std::to_string (opt_Kinc);
+  context += "\n" + game_cache::build_configuration ();
+  context += "\n" + strategy.describe ();
+
+  cache = game_cache (dir, context);
+}
+
+void composition_mt::write_result (pipe_t& pipe, job_result& res) {
+  pipe.write_guard (MESSAGE_START);
+  pipe.write_obj<result_type> (res.type);
+  if (res.type == r_game)
+    pipe.write_safety_game (res.game);
+  else if (res.type == r_invariant)
+    pipe.write_bdd (res.condition, dict);
+  pipe.write_guard (MESSAGE_END);
+}
+
+job_result composition_mt::read_result (pipe_t& pipe) {
+  job_result res;
+  pipe.read_guard (MESSAGE_START);
+  res.type = pipe.read_obj<result_type> ();
+  if ((unsigned) res.type > r_cancelled)
+    throw pipe_t::malformed_message {};
+  if (res.type == r_game)
+    res.game = pipe.read_safety_game (dict);
+  else if (res.type == r_invariant)
+    res.condition = pipe.read_bdd (dict);
+  pipe.read_guard (MESSAGE_END);
+  return res;
 }
 
 void composition_mt::add_invariant (bdd inv) {
@@ -240,12 +449,15 @@ void composition_mt::add_invariant (bdd inv) {
 }
 
 void composition_mt::add_formula (spot::formula f) {
-  enqueue (std::make_shared<job_formula> (f));
+  formulas.push_back (f);
 }
 
 void composition_mt::finish_invariant() {
-  // create 2-state solved automaton for all invariants found
-  if (invariant != bddtrue) {
+  // create 2-state solved automaton for all invariants found; every component
+  // gets one, as the invariants constrain the IOs all of them choose from
+  if (invariant == bddtrue)
+    return;
+  for (size_t c = 0; c < results.size (); c++) {
     safety_game invariant_aut;
     invariant_aut.bool_threshold = 1;
 
@@ -265,7 +477,7 @@ void composition_mt::finish_invariant() {
     invariant_aut.safe = std::make_shared<GenericDownset> (GenericDownset::value_type (safe));
     invariant_aut.aut = aut;
 
-    add_result (invariant_aut);
+    add_result (invariant_aut, c);
   }
 }
 
@@ -280,17 +492,41 @@ void composition_mt::solve_game (safety_game& game) {
   constexpr auto STATIC_ARRAY_CAP_MAX =
     posets::vectors::traits<posets::vectors::ARRAY_IMPL, VECTOR_ELT_T>::capacity_for (STATIC_ARRAY_MAX);
 
-  if (actual_nonbools <= STATIC_ARRAY_CAP_MAX) { // Array & Bitsets
-    static_switch_t<STATIC_ARRAY_CAP_MAX> {} (
-    [&] (auto vnonbools) {
+  // the strategies are chosen once, everything below is specialized for them
+  strategies::solvers::apply (strategy.solver, [&] (auto solver) {
+    if (actual_nonbools <= STATIC_ARRAY_CAP_MAX) { // Array & Bitsets
+      static_switch_t<STATIC_ARRAY_CAP_MAX> {} (
+      [&] (auto vnonbools) {
+        static_switch_t<STATIC_MAX_BITSETS> {} (
+        [&] (auto vbitsets) {
+          using SpecializedDownset = posets::downsets::ARRAY_AND_BITSET_DOWNSET_IMPL<
+            posets::vectors::x_and_bitset<
+              posets::vectors::ARRAY_IMPL<VECTOR_ELT_T, std::max (vnonbools.value, 1UL)>,
+              vbitsets.value>>;
+          auto skn = k_bounded_safety_aut_for<SpecializedDownset>
+          (solver, game.aut, opt_Kmin, opt_K, opt_Kinc, all_inputs, all_outputs);
+          assert (game.safe);
+          auto current_safe = cast_downset<SpecializedDownset> (*game.safe);
+          auto safe = skn.solve (current_safe, invariant, init_state);
+          if (safe.has_value ()) {
+            game.safe = std::make_shared<GenericDownset> (cast_downset<GenericDownset> (safe.value ()));
+          } else game.safe = nullptr;
+        },
+        UNREACHABLE,
+        posets::vectors::nbools_to_nbitsets (nbitsetbools));
+      },
+      UNREACHABLE,
+      actual_nonbools);
+    }
+    else {                                  // Vectors & Bitsets
       static_switch_t<STATIC_MAX_BITSETS> {} (
       [&] (auto vbitsets) {
-        using SpecializedDownset = posets::downsets::ARRAY_AND_BITSET_DOWNSET_IMPL<
-          posets::vectors::x_and_bitset<
-            posets::vectors::ARRAY_IMPL<VECTOR_ELT_T, std::max (vnonbools.value, 1UL)>,
-            vbitsets.value>>;
-        auto skn = K_BOUNDED_SAFETY_AUT_IMPL<SpecializedDownset>
-        (game.aut, opt_Kmin, opt_K, opt_Kinc, all_inputs, all_outputs);
+        using SpecializedDownset = posets::downsets::VECTOR_AND_BITSET_DOWNSET_IMPL<
+        posets::vectors::x_and_bitset<
+        posets::vectors::VECTOR_IMPL<VECTOR_ELT_T>,
+        vbitsets.value>>;
+        auto skn = k_bounded_safety_aut_for<SpecializedDownset>
+        (solver, game.aut, opt_Kmin, opt_K, opt_Kinc, all_inputs, all_outputs);
         assert (game.safe);
         auto current_safe = cast_downset<SpecializedDownset> (*game.safe);
         auto safe = skn.solve (current_safe, invariant, init_state);
@@ -300,29 +536,8 @@ void composition_mt::solve_game (safety_game& game) {
       },
       UNREACHABLE,
       posets::vectors::nbools_to_nbitsets (nbitsetbools));
-    },
-    UNREACHABLE,
-    actual_nonbools);
-  }
-  else {                                  // Vectors & Bitsets
-    static_switch_t<STATIC_MAX_BITSETS> {} (
-    [&] (auto vbitsets) {
-      using SpecializedDownset = posets::downsets::VECTOR_AND_BITSET_DOWNSET_IMPL<
-      posets::vectors::x_and_bitset<
-      posets::vectors::VECTOR_IMPL<VECTOR_ELT_T>,
-      vbitsets.value>>;
-      auto skn = K_BOUNDED_SAFETY_AUT_IMPL<SpecializedDownset>
-      (game.aut, opt_Kmin, opt_K, opt_Kinc, all_inputs, all_outputs);
-      assert (game.safe);
-      auto current_safe = cast_downset<SpecializedDownset> (*game.safe);
-      auto safe = skn.solve (current_safe, invariant, init_state);
-      if (safe.has_value ()) {
-        game.safe = std::make_shared<GenericDownset> (cast_downset<GenericDownset> (safe.value ()));
-      } else game.safe = nullptr;
-    },
-    UNREACHABLE,
-    posets::vectors::nbools_to_nbitsets (nbitsetbools));
-  }
+    }
+  });
 
   game.solved = true;
   game.invariant = invariant;
@@ -337,60 +552,107 @@ int composition_mt::epilogue (std::string synth_fname, std::string winreg_fname)
     return 0;
   }
 
-  // check stored_result
-  if (!stored_result) {
-    // can happen if there are only invariants -> make a dummy automaton with 1 non-accepting state
-    safety_game r;
+  std::vector<controller> controllers;
+  spot::twa_graph_ptr names_aut; // automaton whose dictionary names the APs of the circuit
 
-    spot::twa_graph_ptr aut = new_automaton (dict);
-    aut->new_states (1);
-    aut->set_init_state (0);
-    aut->new_edge (0, 0, bddtrue);
+  for (size_t c = 0; c < results.size (); c++) {
+    // every merge is done once no worker is left
+    assert (results[c].size () <= 1);
+    std::shared_ptr<safety_game> stored_result;
+    if (!results[c].empty ())
+      stored_result = results[c].top ();
 
-    r.solved = true;
+    // check stored_result
+    if (!stored_result) {
+      // can happen if there are only invariants -> make a dummy automaton with 1 non-accepting state
+      safety_game r;
 
-    auto safe = posets::utils::vector_mm<VECTOR_ELT_T> (aut->num_states (), 0);
-    safe[0] = 0;
-    r.safe = std::make_shared<GenericDownset> (GenericDownset::value_type (safe));
-    r.aut = aut;
-    r.invariant = invariant;
+      spot::twa_graph_ptr aut = new_automaton (dict);
+      aut->new_states (1);
+      aut->set_init_state (0);
+      aut->new_edge (0, 0, bddtrue);
 
-    stored_result = std::make_shared<safety_game> (r);
-  }
+      r.solved = true;
 
-  safety_game& r = *stored_result;
+      auto safe = posets::utils::vector_mm<VECTOR_ELT_T> (aut->num_states (), 0);
+      safe[0] = 0;
+      r.safe = std::make_shared<GenericDownset> (GenericDownset::value_type (safe));
+      r.aut = aut;
+      r.invariant = invariant;
 
-  // if the final result was not solved, or it was solved with the wrong invariant (if the IOs precomputer uses it in the first place)
-  // then a final solve is needed before calling synthesis
-  bool not_fully_solved = ((r.invariant != invariant) && IOS_PRECOMPUTER::supports_invariant);
+      stored_result = std::make_shared<safety_game> (r);
+    }
 
-  // there is a special case of having had found all states to be bounded
-  // this should only happen when checking UNREAL, and it means we can
-  // return true
-  if (r.aut == nullptr) {
-    assert (synth_fname.empty ());
-    return true;
-  }
+    safety_game& r = *stored_result;
 
-  if ((!r.solved) || not_fully_solved) {
-    if (!r.solved) verb_do (1, vout << "Not fully solved -> extra solve\n");
-    if (not_fully_solved) verb_do (1, vout << "Solved but not with the right invariant -> extra solve\n");
-    solve_game (r);
-  }
+    // if the final result was not solved, or it was solved with the wrong invariant (if the IOs precomputer uses it in the first place)
+    // then a final solve is needed before calling synthesis
+    bool not_fully_solved = ((r.invariant != invariant) && strategy.supports_invariant ());
+
+    // there is a special case of having had found all states to be bounded
+    // this should only happen when checking UNREAL, and it means that this
+    // component is winning; the others still have to be looked at
+    if (r.aut == nullptr) {
+      assert (synth_fname.empty ());
+      continue;
+    }
 
-  // call synthesis if needed
-  if ((r.safe != nullptr) and (not synth_fname.empty () or not winreg_fname.empty ())) {
-    r.set_globals ();
-    auto skn = K_BOUNDED_SAFETY_AUT_IMPL<GenericDownset>
-      (r.aut, opt_Kmin, opt_K, opt_Kinc, all_inputs, all_outputs);
-    if (!winreg_fname.empty ())
-      skn.winregion (*r.safe, winreg_fname, invariant, init_state);
-    if (!synth_fname.empty ())
-      skn.synthesis (*r.safe, synth_fname, invariant, init_state);
+    // the safe region was only passed on so far
+    if (r.segment) {
+      r.safe = pipe_t::load_segment (*r.segment);
+      r.segment = nullptr;
+    }
+
+    if ((!r.solved) || not_fully_solved) {
+      if (!r.solved) verb_do (1, vout << "Not fully solved -> extra solve\n");
+      if (not_fully_solved) verb_do (1, vout << "Solved but not with the right invariant -> extra solve\n");
+      solve_game (r);
+    }
+
+    // if there is no safe region: return 0 (not winning)
+    if (r.safe == nullptr) {
+      verb_do (1, vout << "Component " << c << " is not winning\n");
+      return 0;
+    }
+
+    // call synthesis if needed
+    if (not synth_fname.empty () or not winreg_fname.empty ()) {
+      r.set_globals ();
+      strategies::solvers::apply (strategy.solver, [&] (auto solver) {
+        auto skn = k_bounded_safety_aut_for<GenericDownset>
+          (solver, r.aut, opt_Kmin, opt_K, opt_Kinc, all_inputs, all_outputs);
+        if (!winreg_fname.empty ())
+          skn.winregion (*r.safe, winreg_fname, invariant, init_state);
+        if (!synth_fname.empty ()) {
+          if (results.size () == 1) {
+            controllers.push_back (skn.synthesize_controller (*r.safe, invariant, init_state));
+          } else {
+            // each component only sets its own outputs, with its own latches
+            controller ctrl = skn.synthesize_controller (*r.safe, invariant, init_state,
+                                                         "_ab_enc" + std::to_string (c) + "_");
+            controller own = ctrl;
+            own.outputs.clear ();
+            own.output_funcs.clear ();
+            for (size_t i = 0; i < ctrl.outputs.size (); i++) {
+              auto name = bdd_to_formula (ctrl.outputs[i]).ap_name ();
+              if (std::ranges::find (component_outputs[c], name) != component_outputs[c].end ()) {
+                own.outputs.push_back (ctrl.outputs[i]);
+                own.output_funcs.push_back (ctrl.output_funcs[i]);
+              }
+            }
+            controllers.push_back (own);
+          }
+          if (!names_aut)
+            names_aut = r.aut;
+        }
+      });
+    }
   }
 
-  // if there is no safe region: return 0 (not winning)
-  return r.safe != nullptr;
+  if (!synth_fname.empty ())
+    write_aiger (controllers, synth_fname, names_aut);
+
+  return 1;
 }
 
 void composition_mt::be_child (int id) {
@@ -402,71 +664,110 @@ void composition_mt::be_child (int id) {
   // keep reading jobs until we are done
   while (true) {
     job_type job = from_main.read_obj<job_type> ();
+    // the main process read the previous result before sending this job
+    to_main.forget_segments ();
+
+    // a job is cancelled when the game is found to be losing: the worker then
+    // waits for its next job, which releases it
+    try {
+      switch (job) {
+        case j_done: {
+          from_main.end_read ();
+          verb_do (1, vout << "Worker is finished!\n");
+          exit (0);
+          break;
+        }
 
-    switch (job) {
-      case j_done: {
-        verb_do (1, vout << "Worker is finished!\n");
-        exit (0);
-        break;
-      }
+        case j_solve: {
+          // update invariant
+          invariant = from_main.read_bdd (dict);
 
-      case j_solve: {
-        // update invariant
-        invariant = from_main.read_bdd (dict);
+          // solve job
+          safety_game r = from_main.read_safety_game (dict);
+          from_main.end_read ();
+          verb_do (1, vout << "Solve job received: read " << from_main.get_bytes_count () << " bytes from pipe\n");
+          verb_do (1, vout << "Starting solve on automaton with " << r.aut->num_states() << " states\n");
 
-        // solve job
-        safety_game r = from_main.read_safety_game (dict);
-        verb_do (1, vout << "Solve job received: read " << from_main.get_bytes_count () << " bytes from pipe\n");
-        verb_do (1, vout << "Starting solve on automaton with " << r.aut->num_states() << " states\n");
+          solve_game (r);
 
-        solve_game (r);
+          job_result res {r_game, r};
+          write_result (to_main, res);
+          to_main.flush ();
 
-        shared_pipe.write_obj<char> (id);
-        to_main.write_guard (MESSAGE_START);
-        to_main.write_obj<result_type> (r_game);
-        to_main.write_safety_game (r);
-        to_main.write_guard (MESSAGE_END);
+          verb_do (1, vout << "Done: wrote " << to_main.get_bytes_count () << " bytes to pipe\n");
+          break;
+        }
 
-        verb_do (1, vout << "Done: wrote " << to_main.get_bytes_count () << " bytes to pipe\n");
-        break;
-      }
+        case j_merge: {
+          invariant = from_main.read_bdd (dict);
 
-      case j_formula: {
-        // turn formula into automaton
-        spot::formula f = from_main.read_formula ();
-        verb_do (1, vout << "Formula job received: read " << from_main.get_bytes_count () << " bytes from pipe\n");
-        verb_do (1, vout << "Formula to be converted: " << f << "\n");
+          // merge the two games, then solve the product
+          safety_game r = from_main.read_safety_game (dict);
+          safety_game other = from_main.read_safety_game (dict);
+          from_main.end_read ();
+          verb_do (1, vout << "Merge job received: read " << from_main.get_bytes_count () << " bytes from pipe\n");
 
-        safety_game r = prepare_formula (f);
+          assert (r.safe);
+          assert (other.safe);
+          verb_do (2, vout << "Merging " << *r.safe << " and " << *other.safe);
 
-        shared_pipe.write_obj<char> (id);
-        to_main.write_guard (MESSAGE_START);
+          auto composer = composition ();
+          composer.merge_aut (r, other);
+          r.safe = std::make_shared<GenericDownset> (composer.merge_saferegions (*r.safe, *other.safe));
+          r.solved = false;
+          verb_do (2, vout << "Merge res: " << *r.safe);
+          verb_do (1, vout << "Starting solve on merged automaton with " << r.aut->num_states() << " states\n");
 
-        if (r.aut) {
-          bdd condition;
-          if (is_invariant (r.aut, condition)) {
-            to_main.write_obj<result_type> (r_invariant);
-            to_main.write_bdd (condition, dict);
+          solve_game (r);
+
+          job_result res {r_game, r};
+          write_result (to_main, res);
+          to_main.flush ();
+
+          verb_do (1, vout << "Done: wrote " << to_main.get_bytes_count () << " bytes to pipe\n");
+          break;
+        }
+
+        case j_formula: {
+          // turn formula into automaton
+          spot::formula f = from_main.read_formula ();
+          from_main.end_read ();
+          verb_do (1, vout << "Formula job received: read " << from_main.get_bytes_count () << " bytes from pipe\n");
+          verb_do (1, vout << "Formula to be converted: " << f << "\n");
+
+          safety_game r = prepare_formula (f);
+
+          job_result res;
+          if (r.aut) {
+            if (is_invariant (r.aut, res.condition))
+              res.type = r_invariant;
+            else {
+              res.type = r_game;
+              res.game = r;
+            }
           } else {
-            to_main.write_obj<result_type> (r_game);
-            to_main.write_safety_game (r);
+            // trivial formula (automaton with no accepting states, like "G true")
+            res.type = r_null;
           }
-        } else {
-          // trivial formula (automaton with no accepting states, like "G true")
-          to_main.write_obj<result_type> (r_null);
-        }
 
-        to_main.write_guard (MESSAGE_END);
+          write_result (to_main, res);
+          to_main.flush ();
 
-        verb_do (1, vout << "Done: wrote " << to_main.get_bytes_count () << " bytes to pipe\n");
-        break;
-      }
+          verb_do (1, vout << "Done: wrote " << to_main.get_bytes_count () << " bytes to pipe\n");
+          break;
+        }
 
-      default: {
-        verb_do (1, vout << "Bad job type!\n");
-        exit (0);
-        break;
+        default: {
+          verb_do (1, vout << "Bad job type!\n");
+          exit (0);
+          break;
+        }
       }
+    } catch (const utils::cancelled&) {
+      verb_do (1, vout << "Job cancelled\n");
+      job_result res {r_cancelled};
+      write_result (to_main, res);
+      to_main.flush ();
     }
   }
 }
@@ -474,6 +775,10 @@ void composition_mt::be_child (int id) {
 int composition_mt::run (int worker_count, std::string synth_fname, std::string winreg_fname) {
   verb_do (1, utils::vout.set_prefix ("[0] "));
 
+  // the winning region is written for a single game: keep the formulas
+  // together when it is asked for
+  split_components (winreg_fname.empty ());
+
   if (worker_count <= 0) {
     worker_count = std::thread::hardware_concurrency ();
   }
@@ -483,35 +788,43 @@ int composition_mt::run (int worker_count, std::string synth_fname, std::string
 
   assert (worker_count > 0);
 
-  // create shared pipe
-  assert (shared_pipe.create_pipe () == 0);
-
   workers.resize (worker_count);
   for(int i = 0; i < worker_count; i++) {
-    assert (workers[i].to_main.create_pipe () == 0);
-    assert (workers[i].from_main.create_pipe () == 0);
+    if (workers[i].to_main.create_pipe () != 0 or
+        workers[i].from_main.create_pipe () != 0) {
+      perror ("pipe");
+      std::abort ();
+    }
+    // the main process never blocks on a worker: results are assembled as
+    // they arrive and jobs are queued until the pipe accepts them
+    workers[i].to_main.make_nonblocking_reader ();
+    workers[i].from_main.make_nonblocking_writer ();
+    // the games solved by a worker are mostly sent to another one, to be
+    // solved or merged, so their safe regions are not built here
+    workers[i].to_main.forward_segments ();
   }
 
   // how many formula jobs aren't yet solved: once this is 0, add invariants, if not using ios precomputer that uses the invariant
   int base_remaining = pending_jobs.size ();
 
-  if constexpr (! IOS_PRECOMPUTER::supports_invariant) {
+  if (not strategy.supports_invariant ()) {
     verb_do (1, vout << "Invariant is not supported -> add safety game for it\n");
   } else {
     verb_do (1, vout << "IOs precomputer supports invariant\n");
   }
 
-  // spawn the workers with their initial job
+  // the workers stop their jobs when this flag is set; the flags of the
+  // processes above are set too, but SIGTERM follows them right away
+  stop_flag.create ();
+  utils::cancel_flags.push_back (stop_flag);
+
+  // spawn the workers
   for(int i = 0; i < worker_count; i++) {
     pid_t pid = fork ();
     assert (pid >= 0);
 
     if (pid > 0) {
       workers[i].pid = pid;
-      job_ptr job = dequeue ();
-      assert (job != nullptr);
-
-      job->to_pipe (workers[i].from_main);
     }
     else {
       // child process
@@ -519,32 +832,79 @@ int composition_mt::run (int worker_count, std::string synth_fname, std::string
     }
   }
 
-  int active_workers = worker_count;
-
+  // the event data is the worker id, with the top bit set for its from_main pipe
+  const uint32_t OUT_EVENT = 1u << 31;
 
-  // wait until a process writes to the shared pipe that it's writing its result
-  while (active_workers > 0) {
-    int wid = shared_pipe.read_obj<char> ();
-    assert ((wid >= 0) && (wid < worker_count));
+  int epfd = epoll_create1 (0);
+  if (epfd < 0) {
+    perror ("epoll_create1");
+    std::abort ();
+  }
 
-    pipe_t& to_main = workers[wid].to_main;
-    pipe_t& from_main = workers[wid].from_main;
+  // only wait for from_main to be writable when there is something queued
+  auto watch_sends = [&] (int wid, int op) {
+    epoll_event ev {};
+    ev.events = workers[wid].from_main.pending_send () ? EPOLLOUT : 0;
+    ev.data.u32 = wid | OUT_EVENT;
+    if (epoll_ctl (epfd, op, workers[wid].from_main.w, &ev) != 0) {
+      perror ("epoll_ctl");
+      std::abort ();
+    }
+  };
 
-    to_main.read_guard (MESSAGE_START);
-    result_type res = to_main.read_obj<result_type> ();
+  for(int i = 0; i < worker_count; i++) {
+    epoll_event ev {};
+    ev.events = EPOLLIN;
+    ev.data.u32 = i;
+    if (epoll_ctl (epfd, EPOLL_CTL_ADD, workers[i].to_main.r, &ev) != 0) {
+      perror ("epoll_ctl");
+      std::abort ();
+    }
+    watch_sends (i, EPOLL_CTL_ADD);
+  }
 
-    switch (res) {
+  int active_workers = worker_count;
+  std::vector<int> idle; // workers waiting for a job
+
+  auto send_job = [&] (int wid, job_ptr job) {
+    workers[wid].job = job;
+    job->set_invariant (invariant);
+    job->to_pipe (workers[wid].from_main);
+    workers[wid].from_main.send_some ();
+    watch_sends (wid, EPOLL_CTL_MOD);
+  };
+
+  auto release = [&] (int wid) {
+    active_workers--;
+    verb_do (1, vout << "Releasing worker " << wid << ": " << active_workers << " left.\n");
+    workers[wid].active = false;
+
+    workers[wid].from_main.write_obj<job_type> (j_done);
+    workers[wid].from_main.flush ();
+    workers[wid].from_main.send_some ();
+    watch_sends (wid, EPOLL_CTL_MOD);
+    // nothing more will be read from this worker
+    epoll_ctl (epfd, EPOLL_CTL_DEL, workers[wid].to_main.r, nullptr);
+  };
+
+  // take the result of a job into account, be it from a worker or from the cache
+  auto process_result = [&] (job_result& res, const job_ptr& job) {
+    switch (res.type) {
       case r_game: {
-      safety_game game = to_main.read_safety_game (dict);
+        safety_game& game = res.game;
 
-        if (game.safe) {
+        if (game.has_safe ()) {
           if (game.solved) {
             verb_do (1, vout << "Solved game -> add as result\n");
-            add_result (game);
+            add_result (game, job->component);
           } else {
             base_remaining--;
             verb_do (1, vout << "Unsolved game -> add solve job\n");
-            enqueue (std::make_shared<job_solve> (game));
+            auto solve = std::make_shared<job_solve> (game);
+            solve->component = job->component;
+            if (auto formula = std::dynamic_pointer_cast<job_formula> (job))
+              solve->origin = spot::str_psl (formula->f);
+            enqueue (solve);
           }
         } else {
           losing = true;
@@ -555,9 +915,8 @@ int composition_mt::run (int worker_count, std::string synth_fname, std::string
 
       case r_invariant: {
         base_remaining--;
-        bdd inv = to_main.read_bdd (dict);
-        verb_do (1, vout << "Read invariant: " << bdd_to_formula (inv) << "\n");
-        add_invariant (inv);
+        verb_do (1, vout << "Read invariant: " << bdd_to_formula (res.condition) << "\n");
+        add_invariant (res.condition);
         break;
       }
 
@@ -567,59 +926,152 @@ int composition_mt::run (int worker_count, std::string synth_fname, std::string
         break;
       }
 
+      case r_cancelled: {
+        // if the game is not losing, the cancellation came from above: the
+        // worker saw the flag before the SIGTERM that follows it
+        verb_do (1, vout << "A job was cancelled\n");
+        if (not losing)
+          interrupted = true;
+        break;
+      }
+
       default:
         assert (false);
     }
 
-    to_main.read_guard (MESSAGE_END);
-
     // if the ios precomputer does not use the invariants, we need to add an automaton that encodes all the invariants
-    if constexpr (! IOS_PRECOMPUTER::supports_invariant) {
+    if (not strategy.supports_invariant ()) {
       if (base_remaining == 0) { // once all formula jobs are finished, we know all invariants
         base_remaining = -1;
         finish_invariant ();
       }
     }
 
-    // kill all workers and immediately abort if found to be losing
-    if (losing) {
-      for(int i = 0; i < worker_count; i++) {
-        if (!workers[i].active) continue;
-        kill (workers[i].pid, SIGKILL);
-        waitpid (workers[i].pid, nullptr, 0);
+    // if found to be losing, stop the jobs of all workers: they all become
+    // idle, and are then released
+    if (losing and not stop_flag.is_set ()) {
+      verb_do (1, vout << "Cancelling the jobs of the workers\n");
+      stop_flag.set ();
+    }
+  };
+
+  // the cached result of a job, if there is one
+  auto load_cached = [&] (const job_ptr& job, job_result& res) {
+    if (not cache.enabled ())
+      return false;
+    auto entry = job->cache_entry ();
+    return not entry.empty () and cache.load (entry, [&] (pipe_t& in) { res = read_result (in); });
+  };
+
+  // give jobs to the idle workers; once they are all idle and there is
+  // nothing left to do, every merge has been done
+  auto dispatch = [&] () {
+    while (not losing and not interrupted and not idle.empty ()) {
+      job_ptr job = next_job ();
+      if (job == nullptr) break;
+      job->set_invariant (invariant);
+      if (job_result res; load_cached (job, res)) {
+        process_result (res, job);
+        continue;
       }
-      break;
+      send_job (idle.back (), job);
+      idle.pop_back ();
     }
+    if ((int) idle.size () == active_workers) {
+      for (int wid : idle)
+        release (wid);
+      idle.clear ();
+    }
+  };
+
+  // the first jobs
+  for(int i = worker_count - 1; i >= 0; i--)
+    idle.push_back (i);
+  dispatch ();
+
+  // handle the whole result that was just loaded from worker wid
+  auto handle_result = [&] (int wid) {
+    pipe_t& to_main = workers[wid].to_main;
+    job_ptr job = workers[wid].job;
 
+    job_result res = read_result (to_main);
+    to_main.end_read ();
     verb_do (1, vout << "Done: read " << to_main.get_bytes_count () << " bytes from pipe\n");
+    // the worker read its whole job before answering
+    workers[wid].from_main.forget_segments ();
 
-    job_ptr new_job = dequeue ();
+    if (cache.enabled () and res.type != r_cancelled) {
+      if (auto entry = job->cache_entry (); not entry.empty ())
+        cache.store (entry, [&] (pipe_t& out) { write_result (out, res); });
+    }
+
+    process_result (res, job);
+
+    // the worker waits for a new job, which may be a merge with this result
+    idle.push_back (wid);
+    dispatch ();
+  };
 
-    if (new_job == nullptr) {
-      active_workers--;
-      verb_do (1, vout << "Releasing worker " << wid << ": " << active_workers << " left.\n");
-      workers[wid].active = false;
+  const int MAX_EVENTS = 64;
+  epoll_event events[MAX_EVENTS];
 
-      from_main.write_obj<job_type> (j_done);
-      // wait for this process
-      waitpid (workers[wid].pid, nullptr, 0);
-    } else {
-      // send new job
-      new_job->set_invariant (invariant);
-      new_job->to_pipe (from_main);
+  while (active_workers > 0) {
+    int n = epoll_wait (epfd, events, MAX_EVENTS, -1);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      perror ("epoll_wait");
+      std::abort ();
+    }
+
+    for (int k = 0; k < n; k++) {
+      uint32_t data = events[k].data.u32;
+      int wid = data & ~OUT_EVENT;
+      assert ((wid >= 0) && (wid < worker_count));
+
+      if (data & OUT_EVENT) {
+        workers[wid].from_main.send_some ();
+        watch_sends (wid, EPOLL_CTL_MOD);
+        continue;
+      }
+
+      if (not workers[wid].active)
+        continue; // released earlier in this batch of events
+
+      if (not workers[wid].to_main.receive ()) {
+        std::fprintf (stderr, "worker %d closed its pipe\n", wid);
+        std::abort ();
+      }
+      while (workers[wid].active and workers[wid].to_main.load_message ())
+        handle_result (wid);
     }
   }
 
+  close (epfd);
+
+  // the released workers exit once they read their last message
+  for(int i = 0; i < worker_count; i++) {
+    if (workers[i].pid < 0) continue;
+    workers[i].from_main.drain ();
+    waitpid (workers[i].pid, nullptr, 0);
+    // segments of jobs a worker did not read, when it was stopped
+    workers[i].from_main.discard_segments ();
+  }
 
   verb_do (1, vout << "All workers are finished.\n");
 
+  utils::cancel_flags.pop_back ();
+  stop_flag.reset ();
+  if (interrupted)
+    throw utils::cancelled ();
+
   return epilogue (synth_fname, winreg_fname);
 }
 
 int composition_mt::run_one (spot::formula f, std::string synth_fname, std::string winreg_fname,
                              bool check_real, unreal_x_t opt_unreal_x) {
   safety_game game = prepare_formula (f, check_real, opt_unreal_x);
-  add_result (game);
+  results.resize (1);
+  add_result (game, 0);
   return epilogue (synth_fname, winreg_fname);
 }
 
@@ -636,35 +1088,58 @@ composition_mt::aut_t composition_mt::push_outputs (const composition_mt::aut_t&
   ret->prop_copy (aut, spot::twa::prop_set::all());
   ret->prop_universal (spot::trival::maybe ());
 
-  static auto cache = utils::make_cache<unsigned> (0u, 0u);
+  // states of ret, by state of aut and saved outputs; the bdds are kept in the
+  // keys so that their ids are not reused
+  struct state_hash {
+    size_t operator() (const std::pair<unsigned, bdd>& p) const {
+      return spot::wang32_hash (p.first) ^ p.second.id ();
+    }
+  };
+  std::unordered_map<std::pair<unsigned, bdd>, unsigned, state_hash> states;
+
   std::stack<std::pair<unsigned, bdd>> to_treat;
   to_treat.push ({ aut->get_init_state_number (), bddtrue });
-  cache (ret->new_state (), aut->get_init_state_number (), bddtrue.id ());
+  states.emplace (to_treat.top (), ret->new_state ());
   while (not to_treat.empty ()) {
-    auto [state, saved_o]  = to_treat.top ();
+    auto [state, saved_o] = to_treat.top ();
     to_treat.pop ();
-    auto ret_state = *cache.get (state, saved_o.id ());
+    auto ret_state = states.at ({ state, saved_o });
     for (auto& e : aut->out (state)) {
-      for (auto&& one_input_bdd : minterms_of (e.cond, all_inputs)) {
-        // Pick one satisfying assignment where outputs all have values
+      // The inputs are split into classes that leave the same choice of
+      // outputs, rather than enumerated: each class is the set of inputs i
+      // for which the cofactor of e.cond by i is a given function of the
+      // outputs.
+      bdd remaining = bdd_exist (e.cond, all_outputs);
+      while (remaining != bddfalse) {
+        bdd one_input_bdd = bdd_satoneset (remaining, all_inputs, bddfalse);
         auto nxt_bdd = bdd_exist (e.cond & one_input_bdd, all_inputs);
-        auto cached = cache.get (e.dst, nxt_bdd.id ());
-        unsigned nxt_state;
-        if (cached)
-          nxt_state = *cached;
-        else {
-          nxt_state = ret->new_state ();
-          cache (nxt_state, e.dst, nxt_bdd.id ());
+        bdd same_outputs = remaining & bdd_forall (bdd_biimp (e.cond, nxt_bdd), all_outputs);
+        remaining -= same_outputs;
+
+        auto [it, inserted] = states.try_emplace ({ e.dst, nxt_bdd }, 0);
+        if (inserted) {
+          it->second = ret->new_state ();
           to_treat.push ({ e.dst, nxt_bdd });
         }
-        ret->new_edge (ret_state, nxt_state, saved_o & one_input_bdd, e.acc);
+        ret->new_edge (ret_state, it->second, saved_o & same_outputs, e.acc);
       }
     }
   }
 
+  ret->merge_edges ();
   return ret;
 }
 
+spot::twa_graph_ptr composition_mt::translate (spot::translator& trans, spot::formula f) {
+  // To Universal co-Büchi Automaton
+  trans.set_type(spot::postprocessor::BA);
+  // "Desired characteristics": Small and state-based acceptance (implied by BA).
+  trans.set_pref(spot::postprocessor::Small |
+                 //spot::postprocessor::Complete | // TODO: We did not need that originally; do we now?
+                 spot::postprocessor::SBAcc);
+  return trans.run (&f);
+}
+
 safety_game composition_mt::prepare_formula (spot::formula f, bool check_real, unreal_x_t opt_unreal_x) {
   // Note: this function is only run once with unrealizability as there is no composition -> swapping the inputs/outputs only happens once
 
@@ -674,13 +1149,6 @@ safety_game composition_mt::prepare_formula (spot::formula f, bool check_real, u
   spot::stopwatch sw, sw_nospot;
   bool want_time = true; // Hardcoded
 
-  // To Universal co-Büchi Automaton
-  trans_.set_type(spot::postprocessor::BA);
-  // "Desired characteristics": Small and state-based acceptance (implied by BA).
-  trans_.set_pref(spot::postprocessor::Small |
-                  //spot::postprocessor::Complete | // TODO: We did not need that originally; do we now?
-                  spot::postprocessor::SBAcc);
-
   if (want_time)
     sw.start ();
 
@@ -706,7 +1174,13 @@ safety_game composition_mt::prepare_formula (spot::formula f, bool check_real, u
 
   verb_do (1, vout << "Formula: " << f << std::endl);
 
-  auto aut = trans_.run (&f);
+  spot::twa_graph_ptr aut;
+  if (auto it = translations.find (f); it != translations.end ()) {
+    verb_do (1, vout << "Automaton translated before forking\n");
+    aut = spot::make_twa_graph (it->second, spot::twa::prop_set::all ());
+  }
+  else
+    aut = translate (trans_, f);
 
   // If unreal but we haven't pushed outputs yet using X on formula
   if (not check_real and opt_unreal_x == UNREAL_X_AUTOMATON) {
@@ -722,6 +1196,7 @@ safety_game composition_mt::prepare_formula (spot::formula f, bool check_real, u
     verb_do (1, vout << "Automaton has " << aut->num_states ()
                 << " states and " << aut->num_sets () << " colors\n");
   }
+  utils::check_cancel ();
 
   ////////////////////////////////////////////////////////////////////////
   // Preprocess automaton
@@ -731,8 +1206,10 @@ safety_game composition_mt::prepare_formula (spot::formula f, bool check_real, u
     sw_nospot.start ();
   }
 
-  auto aut_preprocessors_maker = AUT_PREPROCESSOR ();
-  (aut_preprocessors_maker.make (aut, all_inputs, all_outputs, opt_K)) ();
+  strategies::aut_preprocessors::apply (strategy.aut_preprocessor, [&] (auto preprocessor) {
+    auto aut_preprocessors_maker = typename decltype (preprocessor)::type ();
+    (aut_preprocessors_maker.make (aut, all_inputs, all_outputs, opt_K)) ();
+  });
 
   if (want_time) {
     double merge_time = sw.stop();
@@ -741,6 +1218,7 @@ safety_game composition_mt::prepare_formula (spot::formula f, bool check_real, u
                 << " states\n");
   }
   verb_do (2, spot::print_hoa (utils::vout, aut, nullptr));
+  utils::check_cancel ();
 
   ////////////////////////////////////////////////////////////////////////
   // Boolean states
@@ -748,14 +1226,17 @@ safety_game composition_mt::prepare_formula (spot::formula f, bool check_real, u
   if (want_time)
     sw.start ();
 
-  auto boolean_states_maker = BOOLEAN_STATES ();
-  posets::vectors::bool_threshold = (boolean_states_maker.make (aut, opt_K)) ();
+  strategies::boolean_states::apply (strategy.boolean_states, [&] (auto states) {
+    auto boolean_states_maker = typename decltype (states)::type ();
+    posets::vectors::bool_threshold = (boolean_states_maker.make (aut, opt_K)) ();
+  });
 
   if (want_time) {
     double boolean_states_time = sw.stop ();
     verb_do (1, vout << "Computation of boolean states in " << boolean_states_time
       /*          */ << "seconds , found " << posets::vectors::bool_threshold << " nonboolean states.\n");
   }
+  utils::check_cancel ();
 
   // Special case: only boolean states, so... no useful accepting state.
   if (!check_real && posets::vectors::bool_threshold == 0) {
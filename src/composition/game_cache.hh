@@ -0,0 +1,169 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <spot/misc/version.hh>
+#include "pipes.hh"
+
+#define CACHE_STRINGIFY_(X) #X
+#define CACHE_STRINGIFY(X) CACHE_STRINGIFY_(X)
+
+// On-disk cache of the results of jobs, for runs on mostly unchanged
+// specifications.
+//
+// An entry is named by the FNV-1a hash of its key, a text that holds
+// everything the result depends on: the context (I/O partition, values of K,
+// build configuration and Spot version) and a description of the job.  The
+// file holds one message written with a pipe_t: a magic number, the key
+// itself, so that a hash collision is a miss, and the result, downsets
+// inline.  Entries are written to a temporary file that is then renamed, so
+// a reader never sees a partial entry.
+//
+// The cache is never needed to solve a game: a file that cannot be read, or
+// that is not an entry, is a miss, and an entry that cannot be written is
+// dropped.
+class game_cache {
+  public:
+  game_cache () = default;
+
+  game_cache (std::string dir, std::string context) : dir (std::move (dir)), context (std::move (context)) {
+    if (mkdir (this->dir.c_str (), 0777) != 0 and errno != EEXIST) {
+      perror ("mkdir");
+      this->dir.clear ();
+    }
+  }
+
+  bool enabled () const {
+    return not dir.empty ();
+  }
+
+  // the configuration the results depend on, besides the options
+  static std::string build_configuration () {
+    std::string conf = std::string ("spot ") + spot::version () +
+      "\n" CACHE_STRINGIFY (AUT_PREPROCESSOR) +
+      "\n" CACHE_STRINGIFY (BOOLEAN_STATES) +
+      "\n" CACHE_STRINGIFY (IOS_PRECOMPUTER) +
+      "\n" CACHE_STRINGIFY (ACTIONER) +
+      "\n" CACHE_STRINGIFY (INPUT_PICKER) +
+      "\n" CACHE_STRINGIFY (VECTOR_ELT_T) +
+      "\nSTATIC_ARRAY_MAX " + std::to_string (STATIC_ARRAY_MAX) +
+      "\nSTATIC_MAX_BITSETS " + std::to_string (STATIC_MAX_BITSETS);
+#ifdef NDEBUG
+    conf += "\nNDEBUG"; // no guards in the messages
+#endif
+    return conf;
+  }
+
+  // read the entry of the given job, if there is one
+  template <typename Read>
+  bool load (const std::string& job, Read&& read) const {
+    std::string key = context + "\n" + job;
+    std::vector<char> data;
+    if (not read_file (path (key), data))
+      return false;
+
+    pipe_t in;
+    bool hit = false;
+    const char* outcome = "malformed entry";
+    try {
+      if (in.load_bytes (data.data (), data.size ()) and in.read_obj<uint32_t> () == MAGIC) {
+        outcome = "collision";
+        if (in.read_string () == key) {
+          read (in);
+          in.end_read ();
+          hit = true;
+          outcome = "hit";
+        }
+      }
+    } catch (const pipe_t::malformed_message&) {
+      outcome = "malformed entry";
+    }
+    verb_do (1, vout << "Cache " << outcome << " for " << job << "\n");
+    return hit;
+  }
+
+  // write the entry of the given job, if possible
+  template <typename Write>
+  void store (const std::string& job, Write&& write) const {
+    std::string key = context + "\n" + job;
+    pipe_t out;
+    out.write_to_memory ();
+    out.disable_shared_memory ();
+    out.write_obj<uint32_t> (MAGIC);
+    out.write_string (key);
+    write (out);
+    out.flush ();
+    auto data = out.take_written ();
+
+    std::string final_path = path (key);
+    std::string tmp_path = final_path + ".tmp" + std::to_string (getpid ());
+    if (not write_file (tmp_path, data) or rename (tmp_path.c_str (), final_path.c_str ()) != 0) {
+      verb_do (1, vout << "Cache entry not stored for " << job << ": " << strerror (errno) << "\n");
+      unlink (tmp_path.c_str ());
+      return;
+    }
+    verb_do (1, vout << "Cache entry stored for " << job << "\n");
+  }
+
+  private:
+  static constexpr uint32_t MAGIC = 0x41424331; // "ABC1"
+
+  std::string dir;
+  std::string context;
+
+  static bool read_file (const std::string& name, std::vector<char>& data) {
+    int fd = open (name.c_str (), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    bool ok = (fstat (fd, &st) == 0);
+    if (ok)
+      data.resize (st.st_size);
+    for (size_t pos = 0; ok and pos < data.size (); ) {
+      ssize_t ret = ::read (fd, data.data () + pos, data.size () - pos);
+      if (ret < 0 and errno == EINTR)
+        continue;
+      ok = (ret > 0);
+      pos += ok ? ret : 0;
+    }
+    close (fd);
+    return ok;
+  }
+
+  static bool write_file (const std::string& name, const std::vector<char>& data) {
+    int fd = open (name.c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0)
+      return false;
+    bool ok = true;
+    for (size_t pos = 0; ok and pos < data.size (); ) {
+      ssize_t ret = ::write (fd, data.data () + pos, data.size () - pos);
+      if (ret < 0 and errno == EINTR)
+        continue;
+      ok = (ret > 0);
+      pos += ok ? ret : 0;
+    }
+    int err = errno;
+    if (close (fd) != 0 and ok) // write errors may only show on close
+      return false;
+    errno = err;
+    return ok;
+  }
+
+  std::string path (const std::string& key) const {
+    uint64_t h = 0xcbf29ce484222325ull; // FNV-1a
+    for (unsigned char c : key) {
+      h ^= c;
+      h *= 0x100000001b3ull;
+    }
+    char name[17];
+    snprintf (name, sizeof (name), "%016llx", (unsigned long long) h);
+    return dir + "/" + name;
+  }
+};
@@ -4,9 +4,23 @@
 
 #pragma once
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <cassert>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
 #include <sstream>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
 #include "types.hh"
 
 // magic values
@@ -31,7 +45,21 @@ const int FORMULA_END = 0x198AB311;
 const int STRING_START = 0x093184CD;
 const int STRING_END = 0x5E183BD2;
 
+// Downsets of at least this many bytes are sent through a shared memory
+// segment rather than through the pipe.
+const size_t SHM_DOWNSET_MIN_BYTES = 1 << 16;
+
 // wrapper around a pipe with functions to read/write basic types and bigger structs
+//
+// Writes are buffered and sent as frames: a uint32_t header holding the
+// length of the payload, with the top bit set on the last frame of a message,
+// followed by the payload.  A message is ended, and sent, with flush ();
+// frames are also sent whenever the buffer holds FRAME_SIZE bytes.
+//
+// A process that must not block on a pipe can make its end non-blocking: sent
+// frames are then queued and written by send_some () when the pipe is ready,
+// and received bytes are accumulated by receive () until load_message () finds
+// a whole message, which is then read from memory by the usual functions.
 class pipe_t {
   public:
 
@@ -41,7 +69,31 @@ class pipe_t {
   };
   int byte_count = 0;
 
+  private:
+  static constexpr uint32_t LAST_FRAME = 0x80000000u;
+  static constexpr size_t FRAME_SIZE = 1 << 16;
+
+  std::vector<char> wbuf = std::vector<char> (sizeof (uint32_t)); // starts with room for the header
+  std::vector<char> rbuf; // payload of the current frame
+  size_t rpos = 0;        // position in rbuf
+  bool rlast = true;      // whether the current frame is the last of its message
+
+  std::vector<std::string> segments; // names of the shared memory segments written
+  bool use_shm = true;               // whether large downsets may go through shared memory
+  bool keep_segments = false;        // whether received segments are left as they are
+
+  bool queue_writes = false; // whether the write end is non-blocking, or memory
+  bool from_memory = false;  // whether the message being read was loaded from memory
+  std::vector<char> txq;     // frames not yet written, from txpos on
+  size_t txpos = 0;
+  std::vector<char> rxq;     // bytes received and not yet loaded, from rxpos on
+  size_t rxpos = 0;
+
   public:
+  // thrown when a message loaded from memory turns out to be malformed, or
+  // when a message read from a pipe is, which is then a bug
+  struct malformed_message {};
+
   pipe_t () {
     // let's not create the pipe() here because we're also not closing it in the destructor
     r = w = -1;
@@ -51,6 +103,113 @@ class pipe_t {
     return pipe (fd);
   }
 
+  // write everything inline, for a pipe_t whose write end is a file that
+  // outlives this process
+  void disable_shared_memory () {
+    use_shm = false;
+  }
+
+  // leave the downsets of the safety games read through this pipe in their
+  // shared memory segments, for a process that mostly passes them on
+  void forward_segments () {
+    keep_segments = true;
+  }
+
+  // build the downset of a segment, which stays where it is
+  static std::shared_ptr<GenericDownset> load_segment (const downset_segment& segment) {
+    size_t bytes = (size_t) segment.size * segment.element_size * sizeof (VECTOR_ELT_T);
+    int fd = shm_open (segment.name.c_str (), O_RDONLY, 0);
+    if (fd < 0) {
+      perror ("shm_open");
+      std::abort ();
+    }
+    void* data = mmap (nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (data == MAP_FAILED) {
+      perror ("mmap");
+      std::abort ();
+    }
+    auto result = build_downset (static_cast<const VECTOR_ELT_T*> (data), segment.size, segment.element_size);
+    munmap (data, bytes);
+    return result;
+  }
+
+  // write the messages to memory, to be taken with take_written (), rather
+  // than to a pipe
+  void write_to_memory () {
+    queue_writes = true;
+  }
+
+  std::vector<char> take_written () {
+    std::vector<char> ret;
+    std::swap (ret, txq);
+    txpos = 0;
+    return ret;
+  }
+
+  // make the n bytes at data, which should hold one whole message and nothing
+  // else, the message being read; returns false if they do not.  Reading past
+  // the end of the message, or lengths that would, then throw
+  // malformed_message, so that untrusted data can be read.
+  bool load_bytes (const char* data, size_t n) {
+    rxq.assign (data, data + n);
+    rxpos = 0;
+    from_memory = true;
+    return load_message () and rxpos == rxq.size ();
+  }
+
+  // check that the message being read holds count more objects of the given
+  // size, if it was loaded from memory; other messages are trusted
+  void expect (size_t count, size_t size) {
+    if (from_memory and count > (rbuf.size () - rpos) / size)
+      throw malformed_message {};
+  }
+
+  // write/read raw bytes
+  void write_bytes (const void* data, size_t n) {
+    const char* p = static_cast<const char*> (data);
+    byte_count += n;
+    while (n > 0) {
+      size_t k = std::min (n, sizeof (uint32_t) + FRAME_SIZE - wbuf.size ());
+      wbuf.insert (wbuf.end (), p, p + k);
+      p += k;
+      n -= k;
+      if (wbuf.size () == sizeof (uint32_t) + FRAME_SIZE)
+        send_frame (false);
+    }
+  }
+
+  void read_bytes (void* data, size_t n) {
+    char* p = static_cast<char*> (data);
+    byte_count += n;
+    while (n > 0) {
+      if (rpos == rbuf.size ()) {
+        if (from_memory)
+          throw malformed_message {};
+        read_frame ();
+      }
+      size_t k = std::min (n, rbuf.size () - rpos);
+      std::memcpy (p, rbuf.data () + rpos, k);
+      rpos += k;
+      p += k;
+      n -= k;
+    }
+  }
+
+  // end the message being written and send it
+  void flush () {
+    send_frame (true);
+  }
+
+  // check that the message being read was read entirely
+  void end_read () {
+    if (from_memory and rpos != rbuf.size ())
+      throw malformed_message {};
+    if (rpos == rbuf.size () and not rlast) // the last frame may be empty
+      read_frame ();
+    assert (rpos == rbuf.size () and rlast);
+  }
+
   // return how many bytes were read/written + reset the counter
   int get_bytes_count () {
     int t = byte_count;
@@ -58,20 +217,110 @@ class pipe_t {
     return t;
   }
 
+  // make the read end non-blocking, to be used with receive () and
+  // load_message (); the write end must not be used by this process
+  void make_nonblocking_reader () {
+    fcntl (r, F_SETFL, fcntl (r, F_GETFL) | O_NONBLOCK);
+  }
+
+  // make the write end non-blocking: flush () queues the frames, and
+  // send_some () writes them
+  void make_nonblocking_writer () {
+    fcntl (w, F_SETFL, fcntl (w, F_GETFL) | O_NONBLOCK);
+    queue_writes = true;
+  }
+
+  bool pending_send () const {
+    return txpos < txq.size ();
+  }
+
+  // write as much of the queued frames as the pipe accepts
+  void send_some () {
+    while (txpos < txq.size ()) {
+      ssize_t ret = write (w, txq.data () + txpos, txq.size () - txpos);
+      if (ret < 0) {
+        if (errno == EINTR)
+          continue;
+        if (errno == EAGAIN or errno == EWOULDBLOCK)
+          return;
+        perror ("write to pipe");
+        std::abort ();
+      }
+      txpos += ret;
+    }
+    txq.clear ();
+    txpos = 0;
+  }
+
+  // make the write end blocking again and write all the queued frames
+  void drain () {
+    fcntl (w, F_SETFL, fcntl (w, F_GETFL) & ~O_NONBLOCK);
+    queue_writes = false;
+    send_some ();
+  }
+
+  // read what is available on the pipe; returns false on end of file
+  bool receive () {
+    if (rxpos > 0 and rxpos * 2 >= rxq.size ()) {
+      rxq.erase (rxq.begin (), rxq.begin () + rxpos);
+      rxpos = 0;
+    }
+    char buf[FRAME_SIZE];
+    while (true) {
+      ssize_t ret = read (r, buf, sizeof (buf));
+      if (ret < 0) {
+        if (errno == EINTR)
+          continue;
+        if (errno == EAGAIN or errno == EWOULDBLOCK)
+          return true;
+        perror ("read from pipe");
+        std::abort ();
+      }
+      if (ret == 0)
+        return false;
+      rxq.insert (rxq.end (), buf, buf + ret);
+    }
+  }
+
+  // if a whole message was received, make it the message being read and
+  // return true
+  bool load_message () {
+    assert (rpos == rbuf.size ());
+    size_t pos = rxpos;
+    std::vector<std::pair<size_t, size_t>> payloads; // (start, length)
+    while (true) {
+      uint32_t header;
+      if (rxq.size () - pos < sizeof (uint32_t))
+        return false;
+      std::memcpy (&header, rxq.data () + pos, sizeof (uint32_t));
+      size_t len = header & ~LAST_FRAME;
+      if (rxq.size () - pos - sizeof (uint32_t) < len)
+        return false;
+      payloads.emplace_back (pos + sizeof (uint32_t), len);
+      pos += sizeof (uint32_t) + len;
+      if (header & LAST_FRAME)
+        break;
+    }
+
+    rbuf.clear ();
+    for (auto [start, len] : payloads)
+      rbuf.insert (rbuf.end (), rxq.begin () + start, rxq.begin () + start + len);
+    rpos = 0;
+    rlast = true;
+    rxpos = pos;
+    return true;
+  }
+
   // write/read any basic type
   template<class T>
   void write_obj (const T& value) {
-    int ret = write (w, &value, sizeof (T));
-    assert(ret > 0);
-    byte_count += ret;
+    write_bytes (&value, sizeof (T));
   }
 
   template<class T>
   T read_obj () {
     T value;
-    int ret = read (r, &value, sizeof (T));
-    assert(ret > 0);
-    byte_count += ret;
+    read_bytes (&value, sizeof (T));
     return value;
   }
 
@@ -83,6 +332,8 @@ class pipe_t {
 
   void read_guard (int expected) {
     int result = read_obj<int> ();
+    if (result != expected and from_memory)
+      throw malformed_message {};
     if (result != expected) {
       printf ("Expected %08x got %08x\n", expected, result);
       fflush (stdout);
@@ -102,66 +353,139 @@ class pipe_t {
   void write_string (const std::string& str) {
     write_guard (STRING_START);
     write_obj<size_t> (str.size ());
-    for(char c: str) {
-      write_obj<char> (c);
-    }
+    write_bytes (str.data (), str.size ());
     write_guard (STRING_END);
   }
 
   std::string read_string () {
     read_guard (STRING_START);
     size_t size = read_obj<size_t> ();
+    expect (size, 1);
     std::string str;
     str.resize (size);
-    for(size_t i = 0; i < size; i++) {
-      str[i] = read_obj<char> ();
-    }
+    read_bytes (str.data (), size);
     read_guard (STRING_END);
     return str;
   }
 
+  // Large downsets are written to a shared memory segment, as a flat array of
+  // the vectors one after the other, and only the name of the segment goes
+  // through the pipe; the reader builds the downset from the mapped segment
+  // and unlinks it.
   void write_downset (GenericDownset& downset) {
     write_guard (DOWNSET_START);
 
-    write_obj<int> (downset.size ()); // number of dominating elements
-    write_obj<int> ((*downset.begin ()).size ()); // number of values per element (= number of states in automaton)
+    int downset_size = downset.size ();
+    int element_size = (*downset.begin ()).size ();
+    write_obj<int> (downset_size); // number of dominating elements
+    write_obj<int> (element_size); // number of values per element (= number of states in automaton)
 
-    for(auto& state: downset) {
-      for(auto& value: state) {
-        write_obj<VECTOR_ELT_T> (value);
+    auto copy_to = [&downset] (VECTOR_ELT_T* data) {
+      for(auto& state: downset) {
+        for(auto& value: state) {
+          *data++ = value;
+        }
       }
+    };
+
+    size_t bytes = (size_t) downset_size * element_size * sizeof (VECTOR_ELT_T);
+    std::optional<std::string> segment;
+    if (use_shm and bytes >= SHM_DOWNSET_MIN_BYTES)
+      segment = create_segment (bytes, copy_to);
+
+    if (segment) {
+      write_obj<char> (1);
+      write_string (*segment);
+    }
+    else {
+      write_obj<char> (0);
+      std::vector<VECTOR_ELT_T> data (bytes / sizeof (VECTOR_ELT_T));
+      copy_to (data.data ());
+      write_bytes (data.data (), bytes);
     }
 
     write_guard (DOWNSET_END);
   }
 
-  std::shared_ptr<GenericDownset> read_downset () {
+  // write a downset that is still in a segment: the segment itself is passed
+  // on, unless the downset must be written inline
+  void write_downset (downset_segment& segment) {
+    if (not use_shm) {
+      write_downset (*load_segment (segment));
+      return;
+    }
+    write_guard (DOWNSET_START);
+    write_obj<int> (segment.size);
+    write_obj<int> (segment.element_size);
+    write_obj<char> (1);
+    write_string (segment.name);
+    write_guard (DOWNSET_END);
+    segment.passed_on = true;
+    segments.push_back (segment.name);
+  }
+
+  // read a downset; if it is in a segment and segments are kept, it is left
+  // there, and only *kept is set
+  std::shared_ptr<GenericDownset> read_downset (std::shared_ptr<downset_segment>* kept = nullptr) {
     read_guard (DOWNSET_START);
 
     int downset_size = read_obj<int> ();
     int element_size = read_obj<int> ();
+    size_t bytes = (size_t) downset_size * element_size * sizeof (VECTOR_ELT_T);
 
     std::shared_ptr<GenericDownset> result;
-    std::vector<GenericDownset::value_type> elements;
-
-    for(int j = 0; j < downset_size; j++) {
-      auto vec = posets::utils::vector_mm<VECTOR_ELT_T> (element_size, 0);
-      for (int i = 0; i < element_size; i++) {
-        vec[i] = read_obj<VECTOR_ELT_T> ();
-      }
-      /*if (result == nullptr) {
-        result = std::make_shared<GenericDownset> (GenericDownset::value_type (vec));
-      }
-      else result->insert (GenericDownset::value_type (vec));
-      */
-      elements.push_back (GenericDownset::value_type (vec));
+    if (read_obj<char> ()) {
+      if (from_memory) // no segment outlives the process that wrote it
+        throw malformed_message {};
+      auto segment = std::make_shared<downset_segment> ();
+      segment->name = read_string ();
+      segment->size = downset_size;
+      segment->element_size = element_size;
+      if (kept)
+        *kept = segment;
+      else
+        result = load_segment (*segment); // then unlinked with segment
+    }
+    else {
+      if (downset_size <= 0 or element_size < 0)
+        throw malformed_message {};
+      expect ((size_t) downset_size * element_size, sizeof (VECTOR_ELT_T));
+      std::vector<VECTOR_ELT_T> data (bytes / sizeof (VECTOR_ELT_T));
+      read_bytes (data.data (), bytes);
+      result = build_downset (data.data (), downset_size, element_size);
     }
-    result = std::make_shared<GenericDownset> (std::move (elements));
 
     read_guard (DOWNSET_END);
     return result;
   }
 
+  // unlink the shared memory segments written through this pipe; this is
+  // for segments that may not have been read, the reader unlinking the others
+  void discard_segments () {
+    for (const auto& name : segments)
+      shm_unlink (name.c_str ());
+    segments.clear ();
+  }
+
+  // the reader has read every message written so far, and with them the
+  // segments, which are now its own
+  void forget_segments () {
+    segments.clear ();
+  }
+
+  // unlink the segments created by the processes of the process group pgid,
+  // once these were stopped, possibly before their segments were read
+  static void discard_group_segments (pid_t pgid) {
+    std::string prefix = "acacia-bonsai-" + std::to_string (pgid) + "-";
+    DIR* dir = opendir ("/dev/shm");
+    if (not dir)
+      return;
+    while (dirent* entry = readdir (dir))
+      if (std::strncmp (entry->d_name, prefix.c_str (), prefix.size ()) == 0)
+        shm_unlink (("/" + std::string (entry->d_name)).c_str ());
+    closedir (dir);
+  }
+
   void write_formula (spot::formula f) {
     write_guard (FORMULA_START);
     // turn it into a string and write this string
@@ -179,27 +503,109 @@ class pipe_t {
     return spot::parse_formula (str);
   }
 
-  void write_bdd (bdd b, spot::bdd_dict_ptr dict) {
+  // BDDs are written in binary form, as a table of nodes shared by all the
+  // BDDs of a message, followed by the index of the root of each BDD.  Nodes
+  // 0 and 1 are bddfalse and bddtrue; every other node is written as the
+  // index of its variable in the table of atomic propositions of the message
+  // (written by name, since variable numbers are local to a process) and the
+  // indices of its low and high children, which appear before it.
+  void write_bdds (const std::vector<bdd>& bdds, spot::bdd_dict_ptr dict) {
     write_guard (BDD_START);
 
-    // turn the BDD into a formula, write that
-    spot::formula f = spot::bdd_to_formula (b, dict);
-    write_formula (f);
+    std::unordered_map<int, unsigned> node_index {{bddfalse.id (), 0}, {bddtrue.id (), 1}};
+    std::unordered_map<int, unsigned> var_index;
+    std::vector<int> vars;
+    std::vector<std::tuple<unsigned, unsigned, unsigned>> nodes;
+
+    auto add_node = [&] (auto& self, const bdd& b) -> unsigned {
+      if (auto it = node_index.find (b.id ()); it != node_index.end ())
+        return it->second;
+      unsigned low = self (self, bdd_low (b)), high = self (self, bdd_high (b));
+      auto [vit, _] = var_index.try_emplace (bdd_var (b), (unsigned) vars.size ());
+      if (vit->second == vars.size ())
+        vars.push_back (bdd_var (b));
+      nodes.emplace_back (vit->second, low, high);
+      return node_index[b.id ()] = (unsigned) nodes.size () + 1;
+    };
+
+    std::vector<unsigned> roots;
+    roots.reserve (bdds.size ());
+    for (const auto& b : bdds)
+      roots.push_back (add_node (add_node, b));
+
+    write_obj<unsigned> (vars.size ());
+    for (int v : vars)
+      write_string (dict->bdd_map[v].f.ap_name ());
+
+    write_obj<unsigned> (nodes.size ());
+    for (const auto& [var, low, high] : nodes) {
+      write_obj<unsigned> (var);
+      write_obj<unsigned> (low);
+      write_obj<unsigned> (high);
+    }
+
+    write_obj<unsigned> (roots.size ());
+    for (auto root : roots)
+      write_obj<unsigned> (root);
 
     write_guard (BDD_END);
   }
 
-  bdd read_bdd (spot::bdd_dict_ptr dict) {
+  std::vector<bdd> read_bdds (spot::bdd_dict_ptr dict) {
     read_guard (BDD_START);
 
-    spot::formula formula = read_formula ();
-    bdd res = spot::formula_to_bdd (formula, dict, this);
+    unsigned nvars = read_obj<unsigned> ();
+    expect (nvars, sizeof (size_t)); // the length of each name
+    std::vector<bdd> vars;
+    vars.reserve (nvars);
+    std::vector<bdd> nodes {bddfalse, bddtrue};
+    try {
+      for (unsigned i = 0; i < nvars; ++i)
+        vars.push_back (bdd_ithvar (dict->register_proposition (spot::formula::ap (read_string ()), this)));
+
+      unsigned nnodes = read_obj<unsigned> ();
+      expect (nnodes, 3 * sizeof (unsigned));
+      nodes.reserve (nnodes + 2);
+      for (unsigned i = 0; i < nnodes; ++i) {
+        unsigned var = read_obj<unsigned> ();
+        unsigned low = read_obj<unsigned> ();
+        unsigned high = read_obj<unsigned> ();
+        if (var >= vars.size () or low >= nodes.size () or high >= nodes.size ())
+          throw malformed_message {};
+        nodes.push_back (bdd_ite (vars[var], nodes[high], nodes[low]));
+      }
+    } catch (const malformed_message&) {
+      dict->unregister_all_my_variables (this);
+      throw;
+    }
     dict->unregister_all_my_variables (this);
 
+    unsigned nroots = read_obj<unsigned> ();
+    expect (nroots, sizeof (unsigned));
+    std::vector<bdd> res;
+    res.reserve (nroots);
+    for (unsigned i = 0; i < nroots; ++i) {
+      unsigned root = read_obj<unsigned> ();
+      if (root >= nodes.size ())
+        throw malformed_message {};
+      res.push_back (nodes[root]);
+    }
+
     read_guard (BDD_END);
     return res;
   }
 
+  void write_bdd (bdd b, spot::bdd_dict_ptr dict) {
+    write_bdds ({b}, dict);
+  }
+
+  bdd read_bdd (spot::bdd_dict_ptr dict) {
+    auto bdds = read_bdds (dict);
+    if (bdds.size () != 1)
+      throw malformed_message {};
+    return bdds.front ();
+  }
+
   void write_automaton (spot::twa_graph_ptr aut) {
     write_guard (AUTOMATON_START);
 
@@ -216,15 +622,17 @@ class pipe_t {
       write_obj<char> (acc);
     }
 
-    // write all the edges
-    unsigned edge_count = 0;
+    // write all the edges, then all their conditions at once so that they
+    // share their BDD nodes
+    std::vector<bdd> conds;
+    conds.reserve (aut->num_edges ());
     for(auto& edge: aut->edges ()) {
       write_obj<unsigned> (edge.src);
       write_obj<unsigned> (edge.dst);
-      write_bdd (edge.cond, aut->get_dict ());
-      edge_count++;
+      conds.push_back (edge.cond);
     }
-    assert (edge_count == aut->num_edges ());
+    assert (conds.size () == aut->num_edges ());
+    write_bdds (conds, aut->get_dict ());
 
     write_guard (AUTOMATON_END);
   }
@@ -235,12 +643,12 @@ class pipe_t {
     spot::twa_graph_ptr aut = new_automaton (dict);
 
     unsigned states = read_obj<unsigned> ();
-    for(unsigned i = 0; i < states; i++) {
-      assert (aut->new_state () == i);
-    }
-
     unsigned edges = read_obj<unsigned> ();
     unsigned init = read_obj<unsigned> ();
+    expect (states, sizeof (char));
+    if (init >= states)
+      throw malformed_message {};
+    aut->new_states (states);
     aut->set_init_state (init);
 
     std::vector<bool> acc (states);
@@ -248,14 +656,24 @@ class pipe_t {
       acc[i] = read_obj<char> ();
     }
 
+    expect (edges, 2 * sizeof (unsigned));
+    std::vector<std::pair<unsigned, unsigned>> src_dst (edges);
+    for(unsigned i = 0; i < edges; i++) {
+      src_dst[i].first = read_obj<unsigned> ();
+      src_dst[i].second = read_obj<unsigned> ();
+      if (src_dst[i].first >= states or src_dst[i].second >= states)
+        throw malformed_message {};
+    }
+    auto conds = read_bdds (dict);
+    if (conds.size () != edges)
+      throw malformed_message {};
+
     for(unsigned i = 0; i < edges; i++) {
-      unsigned src = read_obj<unsigned> ();
-      unsigned dst = read_obj<unsigned> ();
-      bdd cond = read_bdd (dict);
+      auto [src, dst] = src_dst[i];
       if (acc[src]) {
-        aut->new_acc_edge (src, dst, cond);
+        aut->new_acc_edge (src, dst, conds[i]);
       } else {
-        aut->new_edge (src, dst, cond);
+        aut->new_edge (src, dst, conds[i]);
       }
     }
 
@@ -283,6 +701,10 @@ class pipe_t {
       write_obj<char> (1);
       write_downset (*r.safe);
     }
+    else if (r.segment) {
+      write_obj<char> (1);
+      write_downset (*r.segment);
+    }
     else write_obj<char> (0);
 
     // write whether this safe region is exact or not
@@ -304,11 +726,115 @@ class pipe_t {
     r.bool_threshold = read_obj<size_t> ();
 
     char has_safe = read_obj<char> ();
-    r.safe = has_safe ? std::shared_ptr<GenericDownset> (read_downset ()) : nullptr;
+    if (has_safe)
+      r.safe = read_downset (keep_segments ? &r.segment : nullptr);
+
+    // what the solver trusts of a game read from memory
+    if (from_memory and r.aut and
+        (r.bool_threshold > r.aut->num_states () or
+         (r.safe and (*r.safe->begin ()).size () != r.aut->num_states ())))
+      throw malformed_message {};
 
     r.solved = read_obj<char> ();
 
     read_guard (SAFETYGAME_END);
     return r;
   }
+
+  private:
+  // build a downset from a flat array of its vectors
+  static std::shared_ptr<GenericDownset> build_downset (const VECTOR_ELT_T* data, int downset_size, int element_size) {
+    std::vector<GenericDownset::value_type> elements;
+    elements.reserve (downset_size);
+    auto vec = posets::utils::vector_mm<VECTOR_ELT_T> (element_size, 0);
+    for(int j = 0; j < downset_size; j++) {
+      for (int i = 0; i < element_size; i++) {
+        vec[i] = *data++;
+      }
+      elements.push_back (GenericDownset::value_type (vec));
+    }
+    return std::make_shared<GenericDownset> (std::move (elements));
+  }
+
+  // create a shared memory segment of the given size, fill it with fill, and
+  // return its name; returns nullopt if the segment could not be created.
+  // The pages are allocated up front: a segment only sized with ftruncate
+  // would get a SIGBUS, rather than an error, when /dev/shm is full.
+  template <typename Fill>
+  std::optional<std::string> create_segment (size_t bytes, const Fill& fill) {
+    static unsigned segment_count = 0;
+    // named after the process group, for discard_group_segments ()
+    std::string name = "/acacia-bonsai-" + std::to_string (getpgrp ()) + "-" + std::to_string (getpid ()) +
+      "-" + std::to_string (segment_count++);
+
+    int fd = shm_open (name.c_str (), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+      return std::nullopt;
+    void* data = MAP_FAILED;
+    if (ftruncate (fd, bytes) == 0 and posix_fallocate (fd, 0, bytes) == 0)
+      data = mmap (nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close (fd);
+    if (data == MAP_FAILED) {
+      shm_unlink (name.c_str ());
+      return std::nullopt;
+    }
+
+    fill (static_cast<VECTOR_ELT_T*> (data));
+    munmap (data, bytes);
+    segments.push_back (name);
+    return name;
+  }
+
+  void send_frame (bool last) {
+    uint32_t header = (uint32_t) (wbuf.size () - sizeof (uint32_t)) | (last ? LAST_FRAME : 0);
+    std::memcpy (wbuf.data (), &header, sizeof (uint32_t));
+    if (queue_writes)
+      txq.insert (txq.end (), wbuf.begin (), wbuf.end ());
+    else
+      write_all (wbuf.data (), wbuf.size ());
+    wbuf.resize (sizeof (uint32_t));
+  }
+
+  void read_frame () {
+    uint32_t header;
+    read_all (&header, sizeof (uint32_t));
+    rlast = header & LAST_FRAME;
+    rbuf.resize (header & ~LAST_FRAME);
+    rpos = 0;
+    read_all (rbuf.data (), rbuf.size ());
+  }
+
+  // write/read exactly n bytes, retrying on short writes/reads and interrupts
+  void write_all (const char* p, size_t n) {
+    while (n > 0) {
+      ssize_t ret = write (w, p, n);
+      if (ret < 0) {
+        if (errno == EINTR)
+          continue;
+        perror ("write to pipe");
+        std::abort ();
+      }
+      p += ret;
+      n -= ret;
+    }
+  }
+
+  void read_all (void* data, size_t n) {
+    char* p = static_cast<char*> (data);
+    while (n > 0) {
+      ssize_t ret = read (r, p, n);
+      if (ret < 0) {
+        if (errno == EINTR)
+          continue;
+        perror ("read from pipe");
+        std::abort ();
+      }
+      if (ret == 0) {
+        fprintf (stderr, "read from pipe: unexpected end of file\n");
+        std::abort ();
+      }
+      p += ret;
+      n -= ret;
+    }
+  }
 };
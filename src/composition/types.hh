@@ -1,5 +1,7 @@
 #pragma once
+#include <sys/mman.h>
 #include <memory>
+#include <string>
 #include "../configuration.hh"
 #include <posets/vectors.hh>
 #include <posets/downsets.hh>
@@ -15,6 +17,21 @@
 // downset type that does not depend on the exact automaton
 using GenericDownset = posets::downsets::VECTOR_AND_BITSET_DOWNSET_IMPL<posets::vectors::vector_backed<VECTOR_ELT_T>>;
 
+// a downset left in the shared memory segment a worker wrote it to, so that
+// the main process can pass it on to another worker without building it; the
+// segment is unlinked with the last copy, unless it was passed on
+struct downset_segment {
+  std::string name;
+  int size = 0;         // number of dominating elements
+  int element_size = 0; // number of values per element
+  bool passed_on = false;
+
+  ~downset_segment () {
+    if (not passed_on)
+      shm_unlink (name.c_str ());
+  }
+};
+
 // Safety game: contains the Büchi automaton and the number of nonboolean states
 // may also contain a downset which is either the safe region if solved == true, or some overestimation if solved == false
 // if this contains no safe region (safe == nullptr), then the game was solved and found to be losing for the controller
@@ -25,6 +42,12 @@ struct safety_game {
   std::shared_ptr<GenericDownset> safe;
   bool solved = false;
   bdd invariant = bddtrue;
+  // where the safe region is instead of safe, if it was received and not built
+  std::shared_ptr<downset_segment> segment;
+
+  bool has_safe () const {
+    return safe or segment;
+  }
 
   auto set_globals () {
     // set the global variables needed for boolean states to function correctly
@@ -109,11 +132,13 @@ enum unreal_x_t {
 enum job_type {
   j_solve,
   j_formula,
+  j_merge,
   j_done
 };
 
 enum result_type {
   r_game,
   r_invariant,
-  r_null
+  r_null,
+  r_cancelled
 };
@@ -12,6 +12,10 @@
 # define DEFAULT_KINC 0
 #endif
 
+#ifndef DEFAULT_THREADS
+# define DEFAULT_THREADS 1
+#endif
+
 #ifndef DEFAULT_UNREAL_X
 # define DEFAULT_UNREAL_X UNREAL_X_BOTH
 #endif
@@ -20,9 +24,6 @@
 # define VECTOR_ELT_T char
 #endif
 
-#ifndef K_BOUNDED_SAFETY_AUT_IMPL
-# define K_BOUNDED_SAFETY_AUT_IMPL k_bounded_safety_aut
-#endif
 #ifdef NDEBUG
 # pragma message ("Compiling with NDEBUG")
 # ifndef STATIC_ARRAY_MAX
@@ -43,6 +44,12 @@
 # endif
 #endif
 
+// Largest number of cubes an edge condition is compiled into by the standard
+// IOs precomputer; beyond it, the BDDs of the conditions are used.
+#ifndef MAX_CUBES_PER_EDGE
+# define MAX_CUBES_PER_EDGE 64ul
+#endif
+
 #ifndef CPRE_AVOID_UNIONS
 # define CPRE_AVOID_UNIONS 0
 #endif
@@ -100,3 +107,15 @@
 #ifndef INPUT_PICKER
 # define INPUT_PICKER input_pickers::critical_pq
 #endif
+
+// Whether the solvers other than the configured one are compiled, to be chosen
+// at runtime.
+#ifndef EXTRA_SOLVERS
+# define EXTRA_SOLVERS 1
+#endif
+
+// Number of critical inputs the input pickers look for in one scan of F; all
+// of them are then used in one CPre step.
+#ifndef MAX_CRITICAL_INPUTS
+# define MAX_CRITICAL_INPUTS 1ul
+#endif
@@ -2,7 +2,9 @@
 
 #include <random>
 #include <optional>
+#include <vector>
 #include "actioners.hh"
+#include "utils/cancel.hh"
 
 namespace input_pickers {
   namespace detail {
@@ -20,6 +22,7 @@ namespace input_pickers {
           // Def: A set C of inputs is critical for F if:
           //        \exists f \in F, i \in C, i witnesses one-step-loss of F.
           // Algo: We go through all f in F, find an input i witnessing one-step-loss, add it to C.
+          //       We stop when C has MAX_CRITICAL_INPUTS elements; an empty C means F is a fixpoint.
 
           // Sort/randomize input_output_fwd_actions
           std::vector<input_and_actions_ref> V (fwd_actions.begin (),
@@ -27,9 +30,10 @@ namespace input_pickers {
 
           std::list<input_and_actions_ref> Cbar (V.begin (), V.end ());
 
-          auto critical_input = Cbar.end ();
+          std::vector<input_and_actions_ref> critical_inputs;
 
           for (const auto& f : F) {
+            utils::check_cancel ();
             bool is_witness = false;
             verb_do (3, vout << "Searching for witness of one-step-loss for " << f << std::endl);
 
@@ -52,7 +56,8 @@ namespace input_pickers {
                 // inputs witness one-step-loss of f
                 verb_do (3, vout << "Input " << input
                          /*   */ << " witnesses one-step-loss of " << f << std::endl);
-                critical_input = it;
+                critical_inputs.push_back (*it);
+                Cbar.erase (it);
                 break;
               }
 
@@ -60,22 +65,21 @@ namespace input_pickers {
               if (it_act != actions.begin ())
                 actions.splice (actions.begin(), actions, it_act);
           }
-            if (critical_input != Cbar.end ())
+            if (critical_inputs.size () == MAX_CRITICAL_INPUTS)
               break;
           }
 
-          if (critical_input == Cbar.end ()) {
+          if (critical_inputs.empty ())
             verb_do (3, vout << "No critical input." << std::endl);
-            return std::optional<input_and_actions_ref> ();
-          }
 
           verb_do (2, {
-              vout << "Critical input: ";
-              const auto& [input, actions] = critical_input->get ();
-              vout << "[" << input << "] " << std::endl;
+              for (const auto& ref : critical_inputs) {
+                const auto& [input, actions] = ref.get ();
+                vout << "Critical input: [" << input << "] " << std::endl;
+              }
             });
 
-          return std::make_optional (*critical_input);
+          return critical_inputs;
         }
       private:
         using input_and_actions_ref = std::reference_wrapper<typename FwdActions::value_type>;
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <algorithm>
 #include <random>
 #include <optional>
+#include <vector>
 #include "actioners.hh"
+#include "utils/cancel.hh"
 
 namespace input_pickers {
   namespace detail {
@@ -24,14 +27,18 @@ namespace input_pickers {
           // Def: A set C of inputs is critical for F if:
           //        \exists f \in F, i \in C, i witnesses one-step-loss of F.
           // Algo: We go through all f in F, find an input i witnessing one-step-loss, add it to C.
+          //       We stop when C has MAX_CRITICAL_INPUTS elements; an empty C means F is a fixpoint.
 
-          auto critical_input = fwd_actions_pq.end ();
+          std::vector<typename fwd_actions_pq_t::iterator> critical_inputs;
 
           for (const auto& f : F) {
+            utils::check_cancel ();
             bool is_witness = false;
             verb_do (3, vout << "Searching for witness of one-step-loss for " << f << std::endl);
 
             for (auto it = fwd_actions_pq.begin (); it != fwd_actions_pq.end (); ++it) {
+              if (std::ranges::find (critical_inputs, it) != critical_inputs.end ())
+                continue;
               auto& [input, actions] = it->second.get ();
               is_witness = true;
               auto it_act = actions.begin ();
@@ -50,7 +57,7 @@ namespace input_pickers {
                 // inputs witness one-step-loss of f
                 verb_do (3, vout << "Input " << input
                          /*   */ << " witnesses one-step-loss of " << f << std::endl);
-                critical_input = it;
+                critical_inputs.push_back (it);
                 break;
               }
 
@@ -58,29 +65,30 @@ namespace input_pickers {
               if (it_act != actions.begin ())
                 actions.splice (actions.begin(), actions, it_act);
             }
-            if (critical_input != fwd_actions_pq.end ())
+            if (critical_inputs.size () == MAX_CRITICAL_INPUTS)
               break;
           }
 
-          if (critical_input == fwd_actions_pq.end ()) {
+          if (critical_inputs.empty ())
             verb_do (3, vout << "No critical input." << std::endl);
-            return std::optional<input_and_actions_ref> ();
-          }
 
-          // Update the hit count of that critical input.
-          {
+          // Update the hit count of the critical inputs.
+          std::vector<input_and_actions_ref> ret;
+          for (auto critical_input : critical_inputs) {
             auto [priority, ref] = *critical_input;
             fwd_actions_pq.erase (critical_input);
-            critical_input = fwd_actions_pq.emplace (priority - 1, ref);
+            fwd_actions_pq.emplace (priority - 1, ref);
+            ret.push_back (ref);
           }
 
           verb_do (2, {
-              vout << "Critical input: ";
-              const auto& [input, actions] = critical_input->second.get ();
-              vout << "[" << input << "] " << std::endl;
+              for (const auto& ref : ret) {
+                const auto& [input, actions] = ref.get ();
+                vout << "Critical input: [" << input << "] " << std::endl;
+              }
             });
 
-          return std::make_optional (critical_input->second);
+          return ret;
         }
       private:
         using input_and_actions_ref = std::reference_wrapper<typename FwdActions::value_type>;
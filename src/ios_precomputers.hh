@@ -3,6 +3,7 @@
 #include "configuration.hh"
 
 #include "ios_precomputers/powset.hh"
+#include "ios_precomputers/powset_inv.hh"
 #include "ios_precomputers/standard.hh"
 #include "ios_precomputers/fake_vars.hh"
 #include "ios_precomputers/delegate.hh"
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "ios_precomputers/powset.hh"
+
+namespace ios_precomputers {
+  namespace detail {
+    // Same as powset, but only the IOs that satisfy the invariant are kept.
+    // The crossings (letters that take the same set of transitions) are
+    // intersected with the invariant before the inputs are partitioned, so that
+    // an input class only lists the actions of the outputs it can be paired
+    // with.
+    template <typename Aut, typename TransSet>
+    class powset_inv {
+      public:
+        powset_inv (Aut aut, bdd input_support, bdd output_support, bdd invariant) :
+          aut {aut}, input_support {input_support}, output_support {output_support},
+          invariant {invariant}
+        {}
+
+        auto operator() () const
+        {
+          using crossings_t = typename std::list<std::pair<bdd, TransSet>>;
+          using input_to_ios_t = typename std::list<std::pair<bdd, std::list<TransSet>>>;
+
+          auto crossings = power<crossings_t> (
+            transition_enumerator (aut, transition_formater::src_and_dst (aut)),
+            [] (bdd b) { return b; });
+
+          for (auto it = crossings.begin (); it != crossings.end (); /* in-loop update */) {
+            it->first &= invariant;
+            if (it->first == bddfalse)
+              it = crossings.erase (it);
+            else
+              ++it;
+          }
+
+          return power<input_to_ios_t> (crossings,
+                                        [this] (bdd b) {
+                                          return bdd_exist (b, output_support);
+                                        });
+        }
+
+      private:
+        Aut aut;
+        const bdd input_support, output_support, invariant;
+    };
+  }
+
+  struct powset_inv {
+    static const bool supports_invariant = true;
+
+      template <typename Aut, typename TransSet = std::vector<std::pair<unsigned, unsigned>>>
+      static auto make (Aut aut, bdd input_support, bdd output_support, bdd invariant) {
+        return detail::powset_inv<Aut, TransSet> (aut, input_support, output_support, invariant);
+      }
+  };
+}
@@ -1,19 +1,122 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <vector>
+
 namespace ios_precomputers {
   namespace detail {
+    /// \brief The edge conditions of an automaton compiled into lists of
+    /// cubes over the I/O variables.
+    ///
+    /// A full letter over the I/O variables is encoded as a word, one bit per
+    /// variable, and an edge is compatible with the letter iff one of the
+    /// cubes (mask, value) of its condition has (letter & mask) == value.
+    /// This replaces a BDD conjunction per edge and per letter by a few word
+    /// operations.
+    template <typename Aut>
+    class compiled_edges {
+      public:
+        struct cube {
+          uint64_t mask, value;
+        };
+
+        struct edge {
+          unsigned dst;
+          std::vector<cube> cubes;
+        };
+
+        // Returns nullptr if there are more than 64 I/O variables, if some edge
+        // condition uses other variables, or if some edge condition has more
+        // than MAX_CUBES_PER_EDGE cubes (as parity-like conditions do, with
+        // exponentially many cubes for a small BDD); the BDDs should then be
+        // used.
+        static std::shared_ptr<const compiled_edges> make (const Aut& aut, bdd support) {
+          auto ret = std::make_shared<compiled_edges> ();
+          ret->var_bit.assign (bdd_varnum (), -1);
+          int nvars = 0;
+          for (bdd s = support; s != bddtrue; s = bdd_high (s)) {
+            if (nvars == 64)
+              return nullptr;
+            ret->var_bit[bdd_var (s)] = nvars++;
+          }
+
+          ret->edges.resize (aut->num_states ());
+          for (size_t p = 0; p < aut->num_states (); ++p)
+            for (const auto& e : aut->out (p)) {
+              edge ce {e.dst, {}};
+              if (not ret->add_cubes (e.cond, 0, 0, ce.cubes))
+                return nullptr;
+              ret->edges[p].push_back (std::move (ce));
+            }
+          return ret;
+        }
+
+        // letter should be a full letter over the I/O variables.
+        uint64_t encode (bdd letter) const {
+          uint64_t bits = 0;
+          while (letter != bddtrue) {
+            uint64_t bit = 1ul << var_bit[bdd_var (letter)];
+            if (bdd_low (letter) == bddfalse) {
+              bits |= bit;
+              letter = bdd_high (letter);
+            }
+            else
+              letter = bdd_low (letter);
+          }
+          return bits;
+        }
+
+        static bool compatible (const edge& e, uint64_t letter) {
+          for (const auto& c : e.cubes)
+            if ((letter & c.mask) == c.value)
+              return true;
+          return false;
+        }
+
+        const auto& out (size_t p) const { return edges[p]; }
+
+      private:
+        // Adds the paths to bddtrue of b to out, prefixed by (mask, value);
+        // fails if out would have more than MAX_CUBES_PER_EDGE cubes.
+        bool add_cubes (bdd b, uint64_t mask, uint64_t value, std::vector<cube>& out) {
+          if (b == bddfalse)
+            return true;
+          if (b == bddtrue) {
+            if (out.size () == MAX_CUBES_PER_EDGE)
+              return false;
+            out.push_back ({mask, value});
+            return true;
+          }
+          int bitno = var_bit[bdd_var (b)];
+          if (bitno == -1)
+            return false;
+          uint64_t bit = 1ul << bitno;
+          return (add_cubes (bdd_low (b), mask | bit, value, out) and
+                  add_cubes (bdd_high (b), mask | bit, value | bit, out));
+        }
+
+        std::vector<int> var_bit; // indexed by BDD variable, -1 if not an I/O variable
+        std::vector<std::vector<edge>> edges;
+    };
+
     template <typename Aut, typename TransSet>
     class standard_container {
       public:
         standard_container (Aut aut,
                             bdd input_support, bdd output_support, bdd invariant) :
-          aut {aut}, input_support {input_support}, output_support {output_support}, invariant {invariant}
+          aut {aut}, input_support {input_support}, output_support {output_support}, invariant {invariant},
+          compiled {compiled_edges_t::make (aut, input_support & output_support)}
         { }
 
       private:
+        using compiled_edges_t = compiled_edges<Aut>;
+        using compiled_ptr = std::shared_ptr<const compiled_edges_t>;
+
         Aut aut;
         bdd input_support, output_support;
         bdd invariant;
+        compiled_ptr compiled; // nullptr if the BDDs are used
 
         class bdd_it {
           public:
@@ -82,8 +185,8 @@ namespace ios_precomputers {
             using iterator_category = std::input_iterator_tag;
             using value_type = TransSet;
 
-            ios_it (bdd input, bdd output_support, Aut aut, bdd inv) :
-              bdd_it (output_support), input {input}, aut {aut}
+            ios_it (bdd input, bdd output_support, Aut aut, bdd inv, compiled_ptr compiled) :
+              bdd_it (output_support), input {input}, aut {aut}, compiled {compiled}
             {
               // set the invariant to include the input, then keep iterating until we find the first output valuation
               // that satisfies the invariant
@@ -113,6 +216,14 @@ namespace ios_precomputers {
               // this updates current_io (set of (p, q) pairs)
               letter = input & bdd_it::current_letter;
               current_io.clear ();
+              if (compiled and letter != bddfalse) {
+                uint64_t bits = compiled->encode (letter);
+                for (size_t p = 0; p < aut->num_states (); ++p)
+                  for (const auto& e : compiled->out (p))
+                    if (compiled_edges_t::compatible (e, bits))
+                      current_io.push_back (std::pair (p, e.dst));
+                return;
+              }
               for (size_t p = 0; p < aut->num_states (); ++p) {
                 for (const auto& e : aut->out (p)) {
                   unsigned q = e.dst;
@@ -127,22 +238,25 @@ namespace ios_precomputers {
             bdd letter;
             TransSet current_io;
             Aut aut;
+            compiled_ptr compiled;
 
             bdd invariant; // includes input
         };
 
         class ios {
           public:
-            ios (bdd input, bdd output_support, Aut aut, bdd invariant) :
-              input {input}, output_support {output_support}, aut {aut}, invariant {invariant} { }
-            ios (ios&& rhs) : input {rhs.input}, output_support {rhs.output_support}, aut {rhs.aut}, invariant {rhs.invariant} {}
+            ios (bdd input, bdd output_support, Aut aut, bdd invariant, compiled_ptr compiled) :
+              input {input}, output_support {output_support}, aut {aut}, invariant {invariant}, compiled {compiled} { }
+            ios (ios&& rhs) : input {rhs.input}, output_support {rhs.output_support}, aut {rhs.aut}, invariant {rhs.invariant},
+                              compiled {rhs.compiled} {}
             ios& operator= (ios&&) = default;
-            ios_it begin () const { return ios_it (input, output_support, aut, invariant); }
-            ios_it end ()   const { return ios_it (bddfalse, bddfalse, aut, invariant); }
+            ios_it begin () const { return ios_it (input, output_support, aut, invariant, compiled); }
+            ios_it end ()   const { return ios_it (bddfalse, bddfalse, aut, invariant, compiled); }
           private:
             bdd input, output_support;
             Aut aut;
             bdd invariant;
+            compiled_ptr compiled;
         };
 
         class in_it : public bdd_it {
@@ -150,10 +264,10 @@ namespace ios_precomputers {
             using iterator_category = std::input_iterator_tag;
             using value_type = std::pair<bdd, ios>;
 
-            in_it (bdd input_support, bdd output_support, Aut aut, bdd _invariant) :
+            in_it (bdd input_support, bdd output_support, Aut aut, bdd _invariant, compiled_ptr _compiled) :
               bdd_it (input_support),
-              current_ios (bdd_it::current_letter, ios (bdd_it::current_letter, output_support, aut, _invariant)),
-              output_support {output_support}, aut {aut}, invariant {_invariant}
+              current_ios (bdd_it::current_letter, ios (bdd_it::current_letter, output_support, aut, _invariant, _compiled)),
+              output_support {output_support}, aut {aut}, invariant {_invariant}, compiled {_compiled}
             { }
 
             auto& operator* ()  { return current_ios; }
@@ -161,23 +275,24 @@ namespace ios_precomputers {
           private:
             virtual void get_next_letter () {
               bdd_it::get_next_letter ();
-              auto theios = std::pair (bdd_it::current_letter, ios (bdd_it::current_letter, output_support, aut, invariant));
+              auto theios = std::pair (bdd_it::current_letter, ios (bdd_it::current_letter, output_support, aut, invariant, compiled));
               current_ios = std::move (theios);
             }
             std::pair<bdd, ios> current_ios;
             bdd output_support;
             Aut aut;
             bdd invariant;
+            compiled_ptr compiled;
         };
 
       public:
-        in_it begin () const { return in_it (input_support, output_support, aut, invariant); }
-        in_it end () const { return in_it (bddfalse, bddfalse, aut, invariant); }
+        in_it begin () const { return in_it (input_support, output_support, aut, invariant, compiled); }
+        in_it end () const { return in_it (bddfalse, bddfalse, aut, invariant, compiled); }
     };
   }
 
   struct standard {
-    static const bool supports_invariant = true; // note: this is only true for this implementation right now, false for the other ios_precomputers
+    static const bool supports_invariant = true; // note: this is only true for this implementation and powset_inv
 
       template <typename Aut, typename TransSet = std::vector<std::pair<int, int>>>
       static auto make (Aut aut,
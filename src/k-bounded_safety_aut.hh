@@ -1,14 +1,14 @@
 #pragma once
 
-#undef MAX_CRITICAL_INPUTS
-#define MAX_CRITICAL_INPUTS 1
-
 #include <algorithm>
 #include <map>
 #include <functional>
 #include <random>
 #include <list>
 #include <chrono>
+#include <memory>
+#include <optional>
+#include <ranges>
 
 #include <spot/twa/formula2bdd.hh>
 #include <spot/twa/twagraph.hh>
@@ -18,6 +18,8 @@
 #include "utils/ref_ptr_cmp.hh"
 #include <utils/verbose.hh>
 #include "utils/typeinfo.hh"
+#include "utils/thread_pool.hh"
+#include "utils/cancel.hh"
 
 #include <posets/utils/vector_mm.hh>
 #include <posets/vectors.hh>
@@ -82,7 +84,7 @@ class k_bounded_safety_aut_detail {
       auto actioner = actioner_maker.make (aut, inputs_to_ios, K);
       verb_do (1, vout << "Fetching IO actions" << std::endl);
       auto input_output_fwd_actions = actioner.actions (); // list<pair<bdd, list<action_vec>>>
-      verb_do (1, io_stats (input_output_fwd_actions));
+      verb_do (1, io_stats (input_output_fwd_actions, actioner));
 
       int loopcount = 0;
 
@@ -99,18 +101,31 @@ class k_bounded_safety_aut_detail {
 
       auto input_picker = input_picker_maker.make (input_output_fwd_actions, actioner);
 
+      if (utils::threads > 1) {
+        verb_do (1, vout << "Using " << utils::threads << " threads for CPre" << std::endl);
+        pool = std::make_unique<utils::thread_pool> (utils::threads);
+      }
+
       do {
+        if (utils::cancel_requested ()) {
+          verb_do (1, vout << "Solve cancelled after " << loopcount << " loops, F of size " << F.size () << std::endl);
+          throw utils::cancelled ();
+        }
+
         loopcount++;
         verb_do (1, vout << "Loop# " << loopcount << ", F of size " << F.size () << std::endl);
 
-        auto&& input = input_picker (F);
-        if (not input.has_value ()) // No more inputs, and we just tested that init was present
+        auto&& inputs = input_picker (F);
+        if (inputs.empty ()) // No more inputs, and we just tested that init was present
         {
           //if (!synth.empty ()) synthesis (F, synth, actioner);
           return std::make_optional<SetOfStates> (std::move (F));
         }
 
-        cpre_inplace (F, *input, actioner);
+        if (inputs.size () == 1)
+          cpre_inplace (F, inputs.front (), actioner);
+        else
+          cpre_batch_inplace (F, inputs, actioner);
 
         if (not F.contains (State (init))) {
           if (K >= Kto)
@@ -149,6 +164,7 @@ class k_bounded_safety_aut_detail {
     const IOsPrecomputationMaker& ios_precomputer_maker;
     const ActionerMaker& actioner_maker;
     const InputPickerMaker& input_picker_maker;
+    std::unique_ptr<utils::thread_pool> pool; // only if more than one thread is used
 
     // This computes F = CPre(F), in the following way:
     // UPre(F) = F \cap F1i
@@ -161,18 +177,24 @@ class k_bounded_safety_aut_detail {
 
       const auto& [input, actions] = io_action.get ();
 #if CPRE_AVOID_UNIONS == 0
+      if (pool and actions.size () > 1) {
+        F.intersect_with (parallel_union_of_pres (F, actions, actioner));
+        verb_do (2, vout << "F = " << std::endl << F);
+        return;
+      }
+
       posets::utils::vector_mm<VECTOR_ELT_T> v (aut->num_states (), -1);
       auto vv = typename SetOfStates::value_type (v);
       SetOfStates F1i (std::move (vv));
       bool first_turn = true;
+      actioners::detail::block_arena arena;
       for (const auto& action_vec : actions) {
         verb_do (3, vout << "one_output_letter:" << std::endl);
 
-        SetOfStates&& F1io = F.apply ([this, &action_vec, &actioner] (const auto& m) {
-          auto&& ret = actioner.apply (m, action_vec, actioners::direction::backward);
-          verb_do (3, vout << "  " << m << " -> " << ret << std::endl);
-          return std::move (ret);
-        });
+        std::vector<State> images;
+        images.reserve (F.size ());
+        actioner.apply_batch (F, action_vec, actioners::direction::backward, images, arena);
+        SetOfStates F1io (std::move (images));
 
         if (first_turn) {
           F1i = std::move (F1io);
@@ -185,16 +207,36 @@ class k_bounded_safety_aut_detail {
       // Compute downset once, before intersection
 
       std::vector<typename SetOfStates::value_type> F1i_vec;
-      F1i_vec.reserve (actions.size () * F.size ());
-      for (const auto& action_vec : actions) {
-        verb_do (3, vout << "one_output_letter:" << std::endl);
+      if (pool and actions.size () > 1) {
+        // Each action fills its own slice of the vector.
+        std::vector<const typename Actioner::action_vec*> action_ptrs;
+        for (const auto& action_vec : actions)
+          action_ptrs.push_back (&action_vec);
+        std::vector<std::vector<State>> slices (action_ptrs.size ());
+        pool->parallel_for (action_ptrs.size (), [&] (size_t a) {
+          actioners::detail::block_arena arena;
+          slices[a].reserve (F.size ());
+          actioner.apply_batch (F, *action_ptrs[a], actioners::direction::backward, slices[a], arena);
+        });
+        F1i_vec.reserve (actions.size () * F.size ());
+        for (auto& slice : slices)
+          std::move (slice.begin (), slice.end (), std::back_inserter (F1i_vec));
+      }
+      else {
+        F1i_vec.reserve (actions.size () * F.size ());
+        actioners::detail::block_arena arena;
+        for (const auto& action_vec : actions) {
+          verb_do (3, vout << "one_output_letter:" << std::endl);
 
-        for (const auto& m : F)
-          F1i_vec.push_back (actioner.apply (m, action_vec, actioners::direction::backward));
+          actioner.apply_batch (F, action_vec, actioners::direction::backward, F1i_vec, arena);
+        }
       }
 
       SetOfStates F1i (std::move (F1i_vec));
 #elif CPRE_AVOID_UNIONS == 2
+      // Intersecting each image with F and building the downset of all the
+      // meets at once was tried: this costs |F| meets per image outside F,
+      // and was not shown to beat mode 0.
 # error Not implemented yet: Remove unions altogether and have intersect take a list
 #endif
 
@@ -205,6 +247,84 @@ class k_bounded_safety_aut_detail {
       verb_do (2, vout << "F = " << std::endl << F);
     }
 
+    // This computes F = F \cap \bigcap_i F1i for a batch of critical inputs i,
+    // with the F1i's all computed from the same F: this is one CPre step in
+    // which the environment can pick any of these inputs.  F is scanned once,
+    // in chunks: each chunk has the actions of all the inputs applied to it
+    // while it is in cache.  F is then intersected with each F1i in turn.
+    template <typename Action, typename Actioner>
+    void cpre_batch_inplace (SetOfStates& F, const std::vector<Action>& io_actions, Actioner& actioner) {
+      verb_do (2, vout << "Computing cpre(F) for " << io_actions.size ()
+               << " inputs with F = " << std::endl << F);
+
+      std::vector<std::reference_wrapper<const State>> elements (F.begin (), F.end ());
+      constexpr size_t chunk_size = 4 * actioners::detail::block_arena::block_size;
+      const size_t nchunks = (elements.size () + chunk_size - 1) / chunk_size;
+
+      // images[c][k] are the images of the chunk c by the actions of input k
+      std::vector<std::vector<std::vector<State>>> images (nchunks,
+                                                           std::vector<std::vector<State>> (io_actions.size ()));
+      auto scan_chunk = [&] (size_t c, actioners::detail::block_arena& arena) {
+        auto first = elements.begin () + c * chunk_size;
+        auto last = elements.begin () + std::min ((c + 1) * chunk_size, elements.size ());
+        auto chunk = std::ranges::subrange (first, last)
+          | std::views::transform ([] (const State& m) -> const State& { return m; });
+        for (size_t k = 0; k < io_actions.size (); ++k)
+          for (const auto& action_vec : io_actions[k].get ().second)
+            actioner.apply_batch (chunk, action_vec, actioners::direction::backward, images[c][k], arena);
+      };
+
+      if (pool and nchunks > 1)
+        pool->parallel_for (nchunks, [&] (size_t c) {
+          actioners::detail::block_arena arena;
+          scan_chunk (c, arena);
+        });
+      else {
+        actioners::detail::block_arena arena;
+        for (size_t c = 0; c < nchunks; ++c)
+          scan_chunk (c, arena);
+      }
+
+      for (size_t k = 0; k < io_actions.size (); ++k) {
+        std::vector<State> F1i_vec;
+        F1i_vec.reserve (io_actions[k].get ().second.size () * F.size ());
+        for (auto& chunk_images : images)
+          std::move (chunk_images[k].begin (), chunk_images[k].end (), std::back_inserter (F1i_vec));
+        F.intersect_with (SetOfStates (std::move (F1i_vec)));
+      }
+      verb_do (2, vout << "F = " << std::endl << F);
+    }
+
+    // Computes F1i = \cup_{o \in O} PreHat (F, i, o) using the thread pool:
+    // each F1io is computed by a separate task, and the union is done as a
+    // balanced binary tree whose levels are also processed in parallel.
+    template <typename Actions, typename Actioner>
+    SetOfStates parallel_union_of_pres (const SetOfStates& F, const Actions& actions,
+                                        const Actioner& actioner) {
+      std::vector<const typename Actions::value_type*> action_ptrs;
+      for (const auto& action_vec : actions)
+        action_ptrs.push_back (&action_vec);
+
+      std::vector<std::optional<SetOfStates>> F1ios (action_ptrs.size ());
+      pool->parallel_for (action_ptrs.size (), [&] (size_t a) {
+        actioners::detail::block_arena arena;
+        std::vector<State> images;
+        images.reserve (F.size ());
+        actioner.apply_batch (F, *action_ptrs[a], actioners::direction::backward, images, arena);
+        F1ios[a].emplace (std::move (images));
+      });
+
+      const size_t n = F1ios.size ();
+      for (size_t stride = 1; stride < n; stride *= 2)
+        pool->parallel_for ((n + 2 * stride - 1) / (2 * stride), [&] (size_t k) {
+          size_t i = 2 * k * stride, j = i + stride;
+          if (j < n)
+            F1ios[i]->union_with (std::move (*F1ios[j]));
+        });
+
+      return std::move (*F1ios[0]);
+    }
+
 
     // get index of the first dominating element that dominates the vector v
     // Container can be SetOfStates, or std::vector
@@ -508,6 +628,13 @@ class k_bounded_safety_aut_detail {
     }
 
     void synthesis(SetOfStates& F, const std::string& synth_fname, bdd invariant, std::vector<int> init_state) {
+      write_aiger ({ synthesize_controller (F, invariant, init_state) }, synth_fname, aut);
+    }
+
+    // compute the latch and output functions of a controller that stays in F;
+    // the latches are new APs whose names start with latch_prefix
+    controller synthesize_controller (SetOfStates& F, bdd invariant, std::vector<int> init_state,
+                                      const std::string& latch_prefix = "_ab_enc_") {
       auto inputs_to_ios = ios_precomputers::standard::make (aut, input_support, output_support, invariant) ();
       auto maker = actioners::standard<typename SetOfStates::value_type> ();
       // manually list the two template types so we can set the third (include IOs) to true
@@ -637,13 +764,13 @@ class k_bounded_safety_aut_detail {
       for (unsigned int i = 0; i < mapping_bits; i++) {
         // Note the long and complex prefix of the variables we introduce:
         // we do not want them to clash with existing APs!
-        unsigned int v = aut->register_ap ("_ab_enc_y" + std::to_string (i));
-        verb_do (2, vout << "_ab_enc_y" << i << " = " << v << std::endl);
+        unsigned int v = aut->register_ap (latch_prefix + "y" + std::to_string (i));
+        verb_do (2, vout << latch_prefix << "y" << i << " = " << v << std::endl);
         state_vars.push_back (bdd_ithvar (v)); // store v instead of the bdd object itself?
         state_vars_cube &= bdd_ithvar (v);
 
-        v = aut->register_ap ("_ab_enc_z" + std::to_string (i));
-        verb_do (2, vout << "_ab_enc_z" << i << " = " << v << std::endl);
+        v = aut->register_ap (latch_prefix + "z" + std::to_string (i));
+        verb_do (2, vout << latch_prefix << "z" << i << " = " << v << std::endl);
         state_vars_prime.push_back (bdd_ithvar (v));
         state_vars_prime_cube &= bdd_ithvar (v);
       }
@@ -701,10 +828,11 @@ class k_bounded_safety_aut_detail {
       std::vector<bdd> input_vector = cube_to_vector (input_support);
       std::vector<bdd> output_vector = cube_to_vector (output_support);
 
-      // AIGER
-      aiger aig (input_vector, state_vars, output_vector, aut);
+      controller ctrl;
+      ctrl.inputs = input_vector;
+      ctrl.latches = state_vars;
+      ctrl.outputs = output_vector;
 
-      int i = 0;
       // for each output: function(current_state, input) that says whether this output is made true
       bdd wosucc = bdd_exist (encoding, state_vars_prime_cube);
       for (const bdd& o : output_vector) {
@@ -714,7 +842,7 @@ class k_bounded_safety_aut_detail {
         neg = !bdd_exist (neg, output_support);
         bdd g_o = (bdd_nodecount (pos) < bdd_nodecount (neg)) ? pos : neg;
         verb_do (2, vout << "g_" << bdd_to_formula (o) << ": " << bdd_to_formula (g_o) << "\n");
-        aig.add_output (i++, g_o);
+        ctrl.output_funcs.push_back (g_o);
         // as a last step, we need to update encoding to fix the function of
         // the output we have just chosen
         wosucc &= ((!g_o) | o) & (g_o | (!o));
@@ -763,7 +891,6 @@ class k_bounded_safety_aut_detail {
                 << '\n';
 #endif
 
-      i = 0;
       // new state as function(current_state, input)
       bdd outless = bdd_exist (encoding, output_support);
       for (const bdd& m : state_vars_prime) {
@@ -773,7 +900,7 @@ class k_bounded_safety_aut_detail {
         neg = !bdd_exist (neg, state_vars_prime_cube);
         bdd f_l = (bdd_nodecount (pos) < bdd_nodecount (neg)) ? pos : neg;
         verb_do (2, vout << "f_" << bdd_to_formula (m) << ": " << bdd_to_formula (f_l) << "\n");
-        aig.add_latch (i++, f_l);
+        ctrl.latch_funcs.push_back (f_l);
         outless &= ((!f_l) | m) & (f_l | (!m));
         assert (outless != bddfalse);
       }
@@ -818,17 +945,7 @@ class k_bounded_safety_aut_detail {
                 << '\n';
 #endif
 
-
-      if (synth_fname != "-") {
-        std::ofstream f (synth_fname);
-        aig.output (f, false);
-        f.close ();
-      } else {
-        utils::vout << "\n\n\n";
-        aig.output (utils::vout, true);
-      }
-
-      verb_do (1, vout << "\n\n");
+      return ctrl;
     }
 
   private:
@@ -863,8 +980,8 @@ class k_bounded_safety_aut_detail {
     ////////////////////////////////////////////////
 
 
-    template <typename IToActions>
-    void io_stats (const IToActions& inputs_to_actions) {
+    template <typename IToActions, typename Actioner>
+    void io_stats (const IToActions& inputs_to_actions, const Actioner& actioner) {
       size_t all_io = 0;
       for (const auto& [inputs, ios] : inputs_to_actions) {
         verb_do (1, vout << "INPUT: " << bdd_to_formula (inputs)
@@ -890,6 +1007,15 @@ class k_bounded_safety_aut_detail {
                   << "IO GAIN: " << all_io << "/" << all_inputs_size * all_outputs_size
                   << " = " << (all_io * 100 / (all_inputs_size * all_outputs_size)) << "%"
                   << std::endl;
+
+      if constexpr (requires { actioner.pruning_stats (); }) {
+        const auto& pruned = actioner.pruning_stats ();
+        utils::vout << "PRUNED ACTIONS: " << pruned.duplicate << " duplicate, "
+                    << pruned.dominated << " dominated" << std::endl;
+      }
+
+      if constexpr (requires { actioner.num_distinct_actions (); })
+        utils::vout << "DISTINCT ACTIONS: " << actioner.num_distinct_actions () << std::endl;
     }
 };
 
@@ -906,13 +1032,14 @@ static auto k_bounded_safety_aut_maker (const spot::twa_graph_ptr& aut, int Kfro
     (aut, Kfrom, Kto, Kinc, input_support, output_support, ios_precomputer_maker, actioner_maker, input_picker_maker);
 }
 
-template <class SetOfStates>
-static auto k_bounded_safety_aut (const spot::twa_graph_ptr& aut, int Kfrom, int Kto, int Kinc,
-                                  bdd input_support, bdd output_support) {
+// with the IOs precomputer, actioner and input picker of one of
+// strategies::solvers
+template <class SetOfStates, class Solver>
+static auto k_bounded_safety_aut_for (Solver, const spot::twa_graph_ptr& aut, int Kfrom, int Kto, int Kinc,
+                                      bdd input_support, bdd output_support) {
   return k_bounded_safety_aut_maker<SetOfStates> (aut, Kfrom, Kto, Kinc,
                                                   input_support, output_support,
-                                                  IOS_PRECOMPUTER (),
-                                                  ACTIONER (),
-                                                  INPUT_PICKER ()
-    );
+                                                  typename Solver::ios_precomputer (),
+                                                  typename Solver::template actioner<SetOfStates> (),
+                                                  typename Solver::input_picker ());
 }
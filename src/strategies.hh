@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <tuple>
+
+#include "configuration.hh"
+#include "utils/static_switch.hh"
+
+#include "aut_preprocessors.hh"
+#include "boolean_states.hh"
+#include "ios_precomputers.hh"
+#include "actioners.hh"
+#include "input_pickers.hh"
+
+// Strategies chosen at runtime.  Each registry lists the strategies compiled
+// in the binary, the first one being given by the configuration macros, so
+// that builds with -D flags keep their meaning as defaults.
+namespace strategies {
+  template <typename... Strategies>
+  struct registry {
+      static constexpr size_t size = sizeof... (Strategies);
+      static constexpr const char* names[] = { Strategies::name... };
+
+      // index of the strategy with that name, or size if there is none
+      static size_t find (std::string_view name) {
+        for (size_t i = 0; i < size; ++i)
+          if (name == names[i])
+            return i;
+        return size;
+      }
+
+      static std::string list () {
+        std::string ret;
+        for (size_t i = 0; i < size; ++i)
+          ret += (i ? ", " : "") + std::string (names[i]);
+        return ret;
+      }
+
+      // call f with a value of the i-th strategy, once, so that what follows is
+      // specialized for it
+      template <typename F>
+      static void apply (size_t i, F&& f) {
+        static_switch_t<size - 1> {} (
+          [&] (auto vi) {
+            f (std::tuple_element_t<vi.value, std::tuple<Strategies...>> {});
+          },
+          [] (size_t) { assert (false); },
+          i);
+      }
+  };
+
+  namespace aut_preprocessor {
+    struct configured { static constexpr auto name = "default"; using type = AUT_PREPROCESSOR; };
+    struct none { static constexpr auto name = "none"; using type = ::aut_preprocessors::no_preprocessing; };
+    struct standard { static constexpr auto name = "standard"; using type = ::aut_preprocessors::standard; };
+    struct surely_losing { static constexpr auto name = "surely-losing"; using type = ::aut_preprocessors::surely_losing; };
+  }
+  using aut_preprocessors = registry<aut_preprocessor::configured, aut_preprocessor::none,
+                                     aut_preprocessor::standard, aut_preprocessor::surely_losing>;
+
+  namespace boolean_state {
+    struct configured { static constexpr auto name = "default"; using type = BOOLEAN_STATES; };
+    struct none { static constexpr auto name = "none"; using type = ::boolean_states::no_boolean_states; };
+    struct forward_saturation { static constexpr auto name = "forward-saturation"; using type = ::boolean_states::forward_saturation; };
+  }
+  using boolean_states = registry<boolean_state::configured, boolean_state::none,
+                                  boolean_state::forward_saturation>;
+
+  // The solvers are compiled for every size of downset, so only the
+  // combinations of IOs precomputer, actioner and input picker found useful in
+  // self-benchmark.sh are listed, and only with EXTRA_SOLVERS.
+  namespace solver {
+    struct configured {
+        static constexpr auto name = "default";
+        using ios_precomputer = IOS_PRECOMPUTER;
+        template <typename SetOfStates>
+        using actioner = ACTIONER;
+        using input_picker = INPUT_PICKER;
+    };
+
+    struct powset {
+        static constexpr auto name = "powset";
+        using ios_precomputer = ::ios_precomputers::powset;
+        template <typename SetOfStates>
+        using actioner = ::actioners::standard<typename SetOfStates::value_type>;
+        using input_picker = ::input_pickers::critical;
+    };
+
+    struct powset_inv {
+        static constexpr auto name = "powset-inv";
+        using ios_precomputer = ::ios_precomputers::powset_inv;
+        template <typename SetOfStates>
+        using actioner = ::actioners::standard<typename SetOfStates::value_type>;
+        using input_picker = ::input_pickers::critical;
+    };
+
+    struct delegate {
+        static constexpr auto name = "delegate";
+        using ios_precomputer = ::ios_precomputers::delegate;
+        template <typename SetOfStates>
+        using actioner = ::actioners::no_ios_precomputation<typename SetOfStates::value_type>;
+        using input_picker = INPUT_PICKER;
+    };
+  }
+#if EXTRA_SOLVERS
+  using solvers = registry<solver::configured, solver::powset, solver::powset_inv, solver::delegate>;
+#else
+  using solvers = registry<solver::configured>;
+#endif
+
+  // the strategies of a run, as indices in the registries
+  struct choice {
+      size_t aut_preprocessor = 0;
+      size_t boolean_states = 0;
+      size_t solver = 0;
+
+      bool supports_invariant () const {
+        bool ret = false;
+        solvers::apply (solver, [&] (auto s) {
+          ret = decltype (s)::ios_precomputer::supports_invariant;
+        });
+        return ret;
+      }
+
+      std::string describe () const {
+        return std::string ("aut-preprocessor ") + aut_preprocessors::names[aut_preprocessor] +
+          " boolean-states " + strategies::boolean_states::names[boolean_states] +
+          " solver " + solvers::names[solver];
+      }
+  };
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace utils {
+  /// \brief A flag in shared memory, seen by the process that creates it and
+  /// by every process it forks afterwards.
+  ///
+  /// Setting it asks all these processes to stop their current computation;
+  /// they notice it at the next call to check_cancel ().  Setting and reading
+  /// the flag is async-signal-safe.
+  ///
+  /// Once a verdict is known, terminate () stops the other processes with
+  /// SIGTERM right after setting the flag, so they seldom see it: in practice,
+  /// flags stop the jobs of the composition workers when a game is losing.
+  class cancel_flag {
+    public:
+      void create () {
+        void* p = mmap (nullptr, sizeof (std::atomic<bool>), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+          perror ("mmap");
+          std::abort ();
+        }
+        flag = new (p) std::atomic<bool> (false);
+      }
+
+      void set () {
+        if (flag) flag->store (true, std::memory_order_relaxed);
+      }
+
+      void reset () {
+        if (flag) flag->store (false, std::memory_order_relaxed);
+      }
+
+      bool is_set () const {
+        return flag and flag->load (std::memory_order_relaxed);
+      }
+
+    private:
+      std::atomic<bool>* flag = nullptr;
+  };
+
+  // Thrown by check_cancel () when the computation is cancelled.
+  struct cancelled {};
+
+  // The flags the current process obeys: the one of the main process, and one
+  // for each level of subprocesses that may be stopped on their own.
+  extern std::vector<cancel_flag> cancel_flags;
+
+  inline bool cancel_requested () {
+    for (const auto& f : cancel_flags)
+      if (f.is_set ())
+        return true;
+    return false;
+  }
+
+  inline void check_cancel () {
+    if (cancel_requested ())
+      throw cancelled ();
+  }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace utils {
+  // Number of threads used within one solving process (set by --threads).
+  extern unsigned threads;
+
+  /// \brief A fixed set of threads that execute parallel loops.
+  ///
+  /// The iterations of a loop are not split in fixed chunks: they are handed
+  /// out one by one from a shared counter, so that a thread that is done with
+  /// a cheap iteration immediately takes over the remaining work.  The calling
+  /// thread takes part in the computation.
+  class thread_pool {
+    public:
+      explicit thread_pool (unsigned nthreads) {
+        for (unsigned i = 1; i < nthreads; ++i)
+          workers.emplace_back ([this] { work (); });
+      }
+
+      ~thread_pool () {
+        {
+          std::lock_guard lock (mutex);
+          stopping = true;
+        }
+        wakeup.notify_all ();
+        for (auto& t : workers)
+          t.join ();
+      }
+
+      thread_pool (const thread_pool&) = delete;
+      thread_pool& operator= (const thread_pool&) = delete;
+
+      size_t size () const { return workers.size () + 1; }
+
+      // Call f (i) for every i in [0, n), and return once all calls are done.
+      template <typename F>
+      void parallel_for (size_t n, F&& f) {
+        if (workers.empty () or n <= 1) {
+          for (size_t i = 0; i < n; ++i)
+            f (i);
+          return;
+        }
+
+        {
+          std::lock_guard lock (mutex);
+          job = [&f] (size_t i) { f (i); };
+          job_size = n;
+          next = 0;
+          busy = workers.size ();
+          ++generation;
+        }
+        wakeup.notify_all ();
+
+        run_job ();
+
+        std::unique_lock lock (mutex);
+        done.wait (lock, [this] { return busy == 0; });
+        job = nullptr;
+      }
+
+    private:
+      void run_job () {
+        for (size_t i = next++; i < job_size; i = next++)
+          job (i);
+      }
+
+      void work () {
+        size_t seen = 0;
+        while (true) {
+          {
+            std::unique_lock lock (mutex);
+            wakeup.wait (lock, [&] { return stopping or generation != seen; });
+            if (stopping)
+              return;
+            seen = generation;
+          }
+          run_job ();
+          {
+            std::lock_guard lock (mutex);
+            if (--busy == 0)
+              done.notify_one ();
+          }
+        }
+      }
+
+      std::vector<std::thread> workers;
+      std::mutex mutex;
+      std::condition_variable wakeup, done;
+      std::function<void (size_t)> job;
+      size_t job_size = 0, busy = 0, generation = 0;
+      std::atomic<size_t> next = 0;
+      bool stopping = false;
+  };
+}
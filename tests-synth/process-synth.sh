@@ -4,6 +4,7 @@
 #              (Based on Jens Kreber's script). This version of the post-
 #              processor uses nuXMV to model check synthesized controllers.
 # arg1 = the absolute path to the benchmark file (.tlsf)
+# arg2 = the build directory; the other arguments are passed to acacia-bonsai
 # - modified to call acacia-bonsai
 
 
@@ -14,6 +15,8 @@ TESTFOLDER=$(mktemp -d)
 syntf="$TESTFOLDER/synthesis.aag"
 origf="$1"
 abpath="$2"
+shift 2
+EXTRA="$*"
 
 # clean up previous test's files
 rm -f $TESTFOLDER/monitor.aig $TESTFOLDER/synthesis.aag $TESTFOLDER/synthesis.aag-combined.aag $TESTFOLDER/synthesis.aag-res
@@ -34,9 +37,9 @@ OUTPS=$(./meyerphi-syfco "$origf" -outs)
 INPS=$(sed 's/ //g' <<< "$INPS")
 OUTPS=$(sed 's/ //g' <<< "$OUTPS")
 
-echo "$abpath/src/acacia-bonsai -f \"$FORMULA\" --ins \"$INPS\" --outs \"$OUTPS\" -S \"$syntf\" --check=real"
+echo "$abpath/src/acacia-bonsai -f \"$FORMULA\" --ins \"$INPS\" --outs \"$OUTPS\" -S \"$syntf\" --check=real $EXTRA"
 # call acacia-bonsai to do synthesis
-eval "$abpath/src/acacia-bonsai -f \"$FORMULA\" --ins \"$INPS\" --outs \"$OUTPS\" -S \"$syntf\" --check=real"
+eval "$abpath/src/acacia-bonsai -f \"$FORMULA\" --ins \"$INPS\" --outs \"$OUTPS\" -S \"$syntf\" --check=real $EXTRA"
 #ltlsynt -f "$FORMULA" --ins="$INPS" --outs="$OUTPS" --aiger | sed '1d' > "$syntf"
 #ltlsynt --tlsf="$origf" --aiger | sed '1d' > "$syntf"
 